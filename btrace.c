@@ -0,0 +1,189 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "btrace.h"
+
+#define BTRACE_MAGIC "QTRB"
+#define BTRACE_HEADER_SIZE 24
+
+/* A command line of the console holds fewer words than this */
+#define BTRACE_MAX_ARGS 4096
+
+struct btrace {
+    uint8_t *map;
+    size_t map_size;
+    const uint8_t *cur, *end; /* Operations not decoded yet */
+    char **strs;
+    uint32_t nr_strs;
+    uint64_t nr_ops, pos;
+    char *argv[BTRACE_MAX_ARGS];
+};
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 |
+           (uint32_t) p[3] << 24;
+}
+
+/* Decode a varint of at most 32 bits, false if it is truncated or larger */
+static bool get_varint(const uint8_t **pp, const uint8_t *end, uint32_t *v)
+{
+    uint64_t x = 0;
+    for (int shift = 0; shift < 35 && *pp < end; shift += 7) {
+        uint8_t b = *(*pp)++;
+        x |= (uint64_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = x;
+            return x <= UINT32_MAX;
+        }
+    }
+    return false;
+}
+
+static bool get_str(btrace_t *bt, char **s, bool optional)
+{
+    uint32_t ref;
+    if (!get_varint(&bt->cur, bt->end, &ref))
+        return false;
+    if (optional && !ref) {
+        *s = NULL;
+        return true;
+    }
+    ref -= optional;
+    if (ref >= bt->nr_strs)
+        return false;
+    *s = bt->strs[ref];
+    return true;
+}
+
+/* Map a compiled trace and check its header and strings */
+btrace_t *btrace_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    btrace_t *bt = calloc(1, sizeof(btrace_t));
+    if (!bt || fstat(fd, &st) || st.st_size < BTRACE_HEADER_SIZE) {
+        close(fd);
+        free(bt);
+        return NULL;
+    }
+
+    bt->map_size = st.st_size;
+    bt->map = mmap(NULL, bt->map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                   0);
+    close(fd);
+    if (bt->map == MAP_FAILED) {
+        free(bt);
+        return NULL;
+    }
+    madvise(bt->map, bt->map_size, MADV_SEQUENTIAL);
+
+    const uint8_t *p = bt->map;
+    bt->end = p + bt->map_size;
+    if (memcmp(p, BTRACE_MAGIC, 4) || get_u32(p + 4) != BTRACE_VERSION ||
+        get_u32(p + 12))
+        goto bad;
+    bt->nr_strs = get_u32(p + 8);
+    bt->nr_ops = get_u32(p + 16) | (uint64_t) get_u32(p + 20) << 32;
+    p += BTRACE_HEADER_SIZE;
+
+    /* Every string takes at least two bytes */
+    if (bt->nr_strs > (size_t) (bt->end - p) / 2)
+        goto bad;
+    bt->strs = malloc(sizeof(char *) * (bt->nr_strs ? bt->nr_strs : 1));
+    if (!bt->strs)
+        goto bad;
+    for (uint32_t i = 0; i < bt->nr_strs; i++) {
+        uint32_t len;
+        if (!get_varint(&p, bt->end, &len) || len >= (size_t) (bt->end - p) ||
+            p[len] || memchr(p, '\0', len))
+            goto bad;
+        bt->strs[i] = (char *) p;
+        p += len + 1;
+    }
+    bt->cur = p;
+    return bt;
+
+bad:
+    btrace_close(bt);
+    return NULL;
+}
+
+/* Unmap a compiled trace */
+void btrace_close(btrace_t *bt)
+{
+    if (!bt)
+        return;
+    munmap(bt->map, bt->map_size);
+    free(bt->strs);
+    free(bt);
+}
+
+/* Decode the next operation */
+int btrace_next(btrace_t *bt, btrace_op_t *op)
+{
+    if (bt->pos == bt->nr_ops)
+        return 0;
+    if (bt->cur == bt->end)
+        return -1;
+
+    op->code = *bt->cur++;
+    op->str = NULL;
+    op->n = 0;
+    op->argc = 0;
+    op->argv = NULL;
+
+    uint32_t argc = 0;
+    bool ok = true;
+    switch (op->code) {
+    case BT_CMD:
+        ok = get_varint(&bt->cur, bt->end, &argc) && argc > 0 &&
+             argc <= BTRACE_MAX_ARGS;
+        for (uint32_t i = 0; ok && i < argc; i++)
+            ok = get_str(bt, &bt->argv[i], false);
+        op->argc = argc;
+        op->argv = bt->argv;
+        break;
+    case BT_IH:
+    case BT_IT:
+        ok = get_str(bt, &op->str, true) &&
+             get_varint(&bt->cur, bt->end, &op->n) && op->n > 0 &&
+             op->n <= INT_MAX;
+        break;
+    case BT_RH:
+    case BT_RT:
+        ok = get_str(bt, &op->str, true);
+        break;
+    case BT_REVERSEK:
+        ok = get_varint(&bt->cur, bt->end, &op->n) && op->n > 0 &&
+             op->n <= INT_MAX;
+        break;
+    case BT_SIZE:
+    case BT_REVERSE:
+    case BT_SWAP:
+    case BT_SORT:
+    case BT_DM:
+        break;
+    default:
+        ok = false;
+    }
+    if (!ok)
+        return -1;
+
+    bt->pos++;
+    return 1;
+}
+
+uint64_t btrace_pos(const btrace_t *bt)
+{
+    return bt->pos;
+}
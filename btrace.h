@@ -0,0 +1,106 @@
+#ifndef LAB0_BTRACE_H
+#define LAB0_BTRACE_H
+
+/* This program reads compiled traces, which hold the commands of a .cmd file
+ * in binary form so that they can be replayed without being parsed again.
+ *
+ * A compiled trace is made by scripts/compile-trace.py. All integers in it
+ * are little-endian. It starts with a 24-byte header:
+ *
+ *   magic "QTRB", u32 version (BTRACE_VERSION), u32 number of strings,
+ *   u32 reserved (0), u64 number of operations
+ *
+ * followed by the string table, each string being a varint length, its bytes
+ * and a null byte, then by the operations, each being an opcode byte and the
+ * varint operands listed for btrace_code_t. Varints are unsigned LEB128.
+ *
+ * A string reference is the index of a string in the table. Optional string
+ * operands are stored as the index plus one, with 0 meaning there is none.
+ */
+
+#include <stdint.h>
+
+#define BTRACE_VERSION 1
+
+/**
+ * btrace_code_t - Opcodes of a compiled trace
+ * @BT_CMD: any command, as argc then argc string references
+ * @BT_IH: ih, as an optional string (none for RAND) then the repetitions
+ * @BT_IT: it, with the same operands as @BT_IH
+ * @BT_RH: rh, as an optional expected string
+ * @BT_RT: rt, with the same operand as @BT_RH
+ * @BT_SIZE: size
+ * @BT_REVERSE: reverse
+ * @BT_SWAP: swap
+ * @BT_SORT: sort
+ * @BT_DM: dm
+ * @BT_REVERSEK: reverseK, as K
+ * @BT_NR_CODES: number of opcodes
+ */
+typedef enum {
+    BT_CMD,
+    BT_IH,
+    BT_IT,
+    BT_RH,
+    BT_RT,
+    BT_SIZE,
+    BT_REVERSE,
+    BT_SWAP,
+    BT_SORT,
+    BT_DM,
+    BT_REVERSEK,
+    BT_NR_CODES,
+} btrace_code_t;
+
+/**
+ * btrace_op_t - Decoded operation
+ * @code: opcode
+ * @str: string operand, NULL if there is none
+ * @n: repetitions of @BT_IH and @BT_IT, K of @BT_REVERSEK
+ * @argc: number of arguments of @BT_CMD
+ * @argv: arguments of @BT_CMD, valid until the next operation is decoded
+ */
+typedef struct {
+    btrace_code_t code;
+    char *str;
+    uint32_t n;
+    int argc;
+    char **argv;
+} btrace_op_t;
+
+typedef struct btrace btrace_t;
+
+/**
+ * btrace_open() - Map a compiled trace and check its header and strings
+ * @path: file name
+ *
+ * Return: NULL if the file cannot be mapped or is not a valid compiled trace
+ */
+btrace_t *btrace_open(const char *path);
+
+/**
+ * btrace_close() - Unmap a compiled trace, no effect if @bt is NULL
+ * @bt: compiled trace
+ */
+void btrace_close(btrace_t *bt);
+
+/**
+ * btrace_next() - Decode the next operation
+ * @bt: compiled trace
+ * @op: where to store the operation
+ *
+ * Strings point into the mapped file, which is private to the process, so
+ * that commands may modify their arguments as they would a parsed line.
+ *
+ * Return: 1 for an operation, 0 at the end of the trace, -1 if the operation
+ * is malformed
+ */
+int btrace_next(btrace_t *bt, btrace_op_t *op);
+
+/**
+ * btrace_pos() - Get the number of operations decoded so far
+ * @bt: compiled trace
+ */
+uint64_t btrace_pos(const btrace_t *bt);
+
+#endif /* LAB0_BTRACE_H */
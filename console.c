@@ -4,11 +4,13 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/select.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "console.h"
@@ -20,6 +22,32 @@ int simulation = 0;
 int show_entropy = 0;
 static cmd_element_t *cmd_list = NULL;
 static param_element_t *param_list = NULL;
+
+/* The lists above are kept sorted for help and completion. Lookups by name go
+ * through open-addressing tables instead, which grow so that at most half of
+ * their slots are in use.
+ */
+typedef struct {
+    const char *name; /* NULL for an empty slot */
+    void *item;
+} name_slot_t;
+
+typedef struct {
+    name_slot_t *slots;
+    size_t size; /* Power of 2, or 0 before the first insertion */
+    size_t count;
+} name_table_t;
+
+static name_table_t cmd_table, param_table;
+
+/* Arguments of the command being interpreted. Both buffers are kept from one
+ * command to the next and only ever grow, so that parsing a line does not
+ * allocate once they are large enough.
+ */
+static char *arg_buf = NULL;
+static size_t arg_buf_size = 0;
+static char **arg_vec = NULL;
+static size_t arg_vec_size = 0;
 static bool block_flag = false;
 static bool prompt_flag = true;
 
@@ -29,6 +57,9 @@ static bool block_timing = false;
 /* Time of day */
 static double first_time, last_time;
 
+/* Where the time taken by each command is recorded, if anywhere */
+static FILE *timefile = NULL;
+
 /* Implement buffered I/O using variant of RIO package from CS:APP
  * Must create stack of buffers to handle I/O with nested source commands.
  */
@@ -70,7 +101,62 @@ static void init_in();
 static bool push_file(char *fname);
 static void pop_file();
 
-static bool interpret_cmda(int argc, char *argv[]);
+/* FNV-1a hash of a name */
+static size_t name_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *) name; *p; p++)
+        h = (h ^ *p) * 16777619u;
+    return h;
+}
+
+/* Find the slot holding name, or the empty slot where it would go */
+static name_slot_t *name_probe(const name_table_t *t, const char *name)
+{
+    size_t mask = t->size - 1;
+    for (size_t i = name_hash(name) & mask;; i = (i + 1) & mask) {
+        name_slot_t *slot = &t->slots[i];
+        if (!slot->name || !strcmp(slot->name, name))
+            return slot;
+    }
+}
+
+static void *name_find(const name_table_t *t, const char *name)
+{
+    return t->size ? name_probe(t, name)->item : NULL;
+}
+
+/* Map name to item, replacing any item already mapped from it */
+static void name_insert(name_table_t *t, const char *name, void *item)
+{
+    if (2 * (t->count + 1) > t->size) {
+        name_slot_t *old = t->slots;
+        size_t old_size = t->size;
+        t->size = old_size ? 2 * old_size : 64;
+        t->slots = calloc_or_fail(t->size, sizeof(name_slot_t), "name_insert");
+        for (size_t i = 0; i < old_size; i++) {
+            if (old[i].name)
+                *name_probe(t, old[i].name) = old[i];
+        }
+        if (old)
+            free_array(old, old_size, sizeof(name_slot_t));
+    }
+
+    name_slot_t *slot = name_probe(t, name);
+    if (!slot->name)
+        t->count++;
+    slot->name = name;
+    slot->item = item;
+}
+
+static void name_clear(name_table_t *t)
+{
+    if (t->slots)
+        free_array(t->slots, t->size, sizeof(name_slot_t));
+    t->slots = NULL;
+    t->size = 0;
+    t->count = 0;
+}
 
 /* Add a new command */
 void add_cmd(char *name, cmd_func_t operation, char *summary, char *param)
@@ -89,6 +175,7 @@ void add_cmd(char *name, cmd_func_t operation, char *summary, char *param)
     cmd->param = param;
     cmd->next = next_cmd;
     *last_loc = cmd;
+    name_insert(&cmd_table, name, cmd);
 }
 
 /* Add a new parameter */
@@ -109,22 +196,34 @@ void add_param(char *name, int *valp, char *summary, setter_func_t setter)
     param->setter = setter;
     param->next = next_param;
     *last_loc = param;
+    name_insert(&param_table, name, param);
 }
 
-/* Parse a string into a command line */
+/* Parse a string into a command line.
+ * The words of line are copied into arg_buf, each null-terminated, and the
+ * returned array points into it. Both are only valid until the next call.
+ */
 static char **parse_args(char *line, int *argcp)
 {
-    /* Must first determine how many arguments there are.
-     * Replace all white space with null characters
-     */
+    /* There are at most (len + 1) / 2 words, each followed by a separator */
     size_t len = strlen(line);
+    if (arg_buf_size < len + 1) {
+        if (arg_buf)
+            free_block(arg_buf, arg_buf_size);
+        arg_buf_size = 2 * arg_buf_size > len + 1 ? 2 * arg_buf_size : len + 1;
+        arg_buf = malloc_or_fail(arg_buf_size, "parse_args");
+    }
+    if (arg_vec_size < (len + 1) / 2) {
+        if (arg_vec)
+            free_array(arg_vec, arg_vec_size, sizeof(char *));
+        arg_vec_size = 2 * arg_vec_size > (len + 1) / 2 ? 2 * arg_vec_size
+                                                        : (len + 1) / 2;
+        arg_vec = calloc_or_fail(arg_vec_size, sizeof(char *), "parse_args");
+    }
 
-    /* First copy into buffer with each substring null-terminated */
-    char *buf = malloc_or_fail(len + 1, "parse_args");
-    buf[len] = '\0';
-
+    /* Replace all white space with null characters */
     char *src = line;
-    char *dst = buf;
+    char *dst = arg_buf;
     bool skipping = true;
     int c;
     int argc = 0;
@@ -138,26 +237,17 @@ static char **parse_args(char *line, int *argcp)
         } else {
             if (skipping) {
                 /* Hit start of new word */
-                argc++;
+                arg_vec[argc++] = dst;
                 skipping = false;
             }
             *dst++ = c;
         }
     }
     /* Let the last substring is null-terminated */
-    *dst++ = '\0';
-
-    /* Now assemble into array of strings */
-    char **argv = calloc_or_fail(argc, sizeof(char *), "parse_args");
-    src = buf;
-    for (int i = 0; i < argc; i++) {
-        argv[i] = strsave_or_fail(src, "parse_args");
-        src += strlen(argv[i]) + 1;
-    }
+    *dst = '\0';
 
-    free_block(buf, len + 1);
     *argcp = argc;
-    return argv;
+    return arg_vec;
 }
 
 /* Handles forced console termination for record_error and do_quit */
@@ -178,13 +268,29 @@ static bool force_quit(int argc, char *argv[])
         free_block(ele, sizeof(param_element_t));
     }
 
+    name_clear(&cmd_table);
+    name_clear(&param_table);
+
     while (buf_stack)
         pop_file();
 
+    if (timefile)
+        fclose(timefile);
+    timefile = NULL;
+
     for (int i = 0; i < quit_helper_cnt; i++) {
         ok = ok && quit_helpers[i](argc, argv);
     }
 
+    /* The quit helpers were the last to read the arguments */
+    if (arg_buf)
+        free_block(arg_buf, arg_buf_size);
+    if (arg_vec)
+        free_array(arg_vec, arg_vec_size, sizeof(char *));
+    arg_buf = NULL;
+    arg_vec = NULL;
+    arg_buf_size = arg_vec_size = 0;
+
     quit_flag = true;
     return ok;
 }
@@ -201,17 +307,24 @@ static void record_error()
 }
 
 /* Execute a command that has already been split into arguments */
-static bool interpret_cmda(int argc, char *argv[])
+bool interpret_cmda(int argc, char *argv[])
 {
     if (argc == 0)
         return true;
     /* Try to find matching command */
-    cmd_element_t *next_cmd = cmd_list;
+    cmd_element_t *next_cmd = name_find(&cmd_table, argv[0]);
     bool ok = true;
-    while (next_cmd && strcmp(argv[0], next_cmd->name) != 0)
-        next_cmd = next_cmd->next;
     if (next_cmd) {
+        struct timespec t0, t1;
+        if (timefile)
+            clock_gettime(CLOCK_MONOTONIC, &t0);
         ok = next_cmd->operation(argc, argv);
+        /* Quitting releases argv, and is not worth timing anyway */
+        if (timefile && !quit_flag) {
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            fprintf(timefile, "%s\t%.9f\n", argv[0],
+                    (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9);
+        }
         if (!ok)
             record_error();
     } else {
@@ -231,12 +344,7 @@ static bool interpret_cmd(char *cmdline)
 
     int argc;
     char **argv = parse_args(cmdline, &argc);
-    bool ok = interpret_cmda(argc, argv);
-    for (int i = 0; i < argc; i++)
-        free_string(argv[i]);
-    free_array(argv, argc, sizeof(char *));
-
-    return ok;
+    return interpret_cmda(argc, argv);
 }
 
 /* Set function to be executed as part of program exit */
@@ -254,6 +362,13 @@ void set_echo(bool on)
     echo = on ? 1 : 0;
 }
 
+/* Record the run time of each command into a file */
+bool set_timefile(const char *file_name)
+{
+    timefile = fopen(file_name, "w");
+    return timefile != NULL;
+}
+
 /* Built-in commands */
 static bool do_quit(int argc, char *argv[])
 {
@@ -321,7 +436,6 @@ static bool do_option(int argc, char *argv[])
     for (int i = 1; i < argc; i++) {
         char *name = argv[i];
         int value = 0;
-        bool found = false;
         /* Get value from next argument */
         if (i + 1 >= argc) {
             report(1, "No value given for parameter %s", name);
@@ -330,23 +444,16 @@ static bool do_option(int argc, char *argv[])
             report(1, "Cannot parse '%s' as integer", argv[i]);
             return false;
         }
-        /* Find parameter in list */
-        param_element_t *plist = param_list;
-        while (!found && plist) {
-            if (strcmp(plist->name, name) == 0) {
-                int oldval = *plist->valp;
-                *plist->valp = value;
-                if (plist->setter)
-                    plist->setter(oldval);
-                found = true;
-            } else
-                plist = plist->next;
-        }
-        /* Didn't find parameter */
-        if (!found) {
+        /* Find parameter */
+        param_element_t *param = name_find(&param_table, name);
+        if (!param) {
             report(1, "Unknown parameter '%s'", name);
             return false;
         }
+        int oldval = *param->valp;
+        *param->valp = value;
+        if (param->setter)
+            param->setter(oldval);
     }
 
     return true;
@@ -430,6 +537,8 @@ void init_cmd()
 {
     cmd_list = NULL;
     param_list = NULL;
+    name_clear(&cmd_table);
+    name_clear(&param_table);
     err_cnt = 0;
     quit_flag = false;
 
@@ -500,13 +609,15 @@ static void init_in()
  */
 static char *readline()
 {
-    char c;
-    char *lptr = linebuf;
-
     if (!buf_stack)
         return NULL;
 
-    for (int cnt = 0; cnt < RIO_BUFSIZE - 2; cnt++) {
+    /* Copy whole runs of the input buffer up to the next newline, leaving
+     * room for a newline and the null terminator.
+     */
+    size_t cnt = 0;
+    bool newline = false;
+    while (!newline && cnt < RIO_BUFSIZE - 2) {
         if (buf_stack->count <= 0) {
             /* Need to read from input file */
             buf_stack->count = read(buf_stack->fd, buf_stack->buf, RIO_BUFSIZE);
@@ -514,39 +625,36 @@ static char *readline()
             if (buf_stack->count <= 0) {
                 /* Encountered EOF */
                 pop_file();
-                if (cnt > 0) {
-                    /* Last line of file did not terminate with newline. */
-                    /*  Terminate line & return it */
-                    *lptr++ = '\n';
-                    *lptr++ = '\0';
-                    if (echo) {
-                        report_noreturn(1, prompt);
-                        report_noreturn(1, linebuf);
-                    }
-                    return linebuf;
-                }
+                /* Last line of file may not terminate with newline */
+                if (cnt > 0)
+                    break;
                 return NULL;
             }
         }
 
         /* Have text in buffer */
-        c = *buf_stack->bufptr++;
-        *lptr++ = c;
-        buf_stack->count--;
-        if (c == '\n')
-            break;
+        size_t n = RIO_BUFSIZE - 2 - cnt;
+        if (n > (size_t) buf_stack->count)
+            n = buf_stack->count;
+        char *nl = memchr(buf_stack->bufptr, '\n', n);
+        if (nl) {
+            n = nl - buf_stack->bufptr + 1;
+            newline = true;
+        }
+        memcpy(linebuf + cnt, buf_stack->bufptr, n);
+        cnt += n;
+        buf_stack->bufptr += n;
+        buf_stack->count -= n;
     }
 
-    if (c != '\n') {
-        /* Hit buffer limit.  Artificially terminate line */
-        *lptr++ = '\n';
+    if (!newline) {
+        /* Hit buffer limit or EOF.  Artificially terminate line */
+        linebuf[cnt++] = '\n';
     }
-    *lptr++ = '\0';
+    linebuf[cnt] = '\0';
 
-    if (echo) {
-        report_noreturn(1, prompt);
-        report_noreturn(1, linebuf);
-    }
+    if (echo)
+        report_noreturn(1, "%s%s", prompt, linebuf);
 
     return linebuf;
 }
@@ -556,6 +664,12 @@ static bool cmd_done()
     return !buf_stack || quit_flag;
 }
 
+/* Has quitting been requested */
+bool quit_requested()
+{
+    return quit_flag;
+}
+
 /* Handle command processing in program that uses select as main control loop.
  * Like select, but checks whether command input either present in internal
  * buffer
@@ -50,6 +50,19 @@ void add_cmd(char *name, cmd_func_t operation, char *summary, char *parameter);
 /* Add a new parameter */
 void add_param(char *name, int *valp, char *summary, setter_func_t setter);
 
+/* Execute a command that has already been split into arguments.
+ * Return true if no errors occurred
+ */
+bool interpret_cmda(int argc, char *argv[]);
+
+/* Return true once the quit command ran or the error limit was exceeded */
+bool quit_requested();
+
+/* Record the name and run time in seconds of every command into file_name,
+ * one tab separated line each. Return true if the file could be opened
+ */
+bool set_timefile(const char *file_name);
+
 /* Extract integer from text and store at loc */
 bool get_int(char *vname, int *loc);
 
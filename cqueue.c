@@ -0,0 +1,124 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "cqueue.h"
+
+/* Keeps the producer and consumer positions on separate cache lines */
+#define CACHE_LINE 64
+
+typedef struct {
+    /* Equal to the position that may fill the cell next, or to that position
+     * plus one once the cell holds an element ready to be popped.
+     */
+    atomic_size_t seq;
+    element_t *data;
+} cq_cell_t;
+
+struct cqueue {
+    cq_cell_t *cells;
+    size_t mask;
+    char pad0[CACHE_LINE - sizeof(cq_cell_t *) - sizeof(size_t)];
+    atomic_size_t tail; /* Next position to push to */
+    char pad1[CACHE_LINE - sizeof(atomic_size_t)];
+    atomic_size_t head; /* Next position to pop from */
+    char pad2[CACHE_LINE - sizeof(atomic_size_t)];
+};
+
+/* Create an empty concurrent queue */
+cqueue_t *cq_new(size_t capacity)
+{
+    if (!capacity || capacity > SIZE_MAX / 2 / sizeof(cq_cell_t))
+        return NULL;
+
+    /* With a single cell, "holds an element" and "free on the next lap"
+     * would be the same sequence number.
+     */
+    size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    cqueue_t *q = malloc(sizeof(cqueue_t));
+    if (!q)
+        return NULL;
+    q->cells = malloc(sizeof(cq_cell_t) * size);
+    if (!q->cells) {
+        free(q);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        atomic_init(&q->cells[i].seq, i);
+        q->cells[i].data = NULL;
+    }
+    q->mask = size - 1;
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+    return q;
+}
+
+/* Free the ring */
+void cq_free(cqueue_t *q)
+{
+    if (!q)
+        return;
+    free(q->cells);
+    free(q);
+}
+
+/* Append an element at the tail */
+bool cq_push(cqueue_t *q, element_t *e)
+{
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    for (;;) {
+        cq_cell_t *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+        if (!diff) {
+            /* The cell is free on this lap, claim the position */
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                cell->data = e;
+                atomic_store_explicit(&cell->seq, pos + 1,
+                                      memory_order_release);
+                return true;
+            }
+            /* pos now holds the tail another producer moved to */
+        } else if (diff < 0) {
+            /* The cell still holds the element pushed one lap earlier */
+            return false;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+}
+
+/* Take the element at the head */
+element_t *cq_pop(cqueue_t *q)
+{
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;) {
+        cq_cell_t *cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+        if (!diff) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                element_t *e = cell->data;
+                /* Hand the cell over to the producer of the next lap */
+                atomic_store_explicit(&cell->seq, pos + q->mask + 1,
+                                      memory_order_release);
+                return e;
+            }
+        } else if (diff < 0) {
+            /* Nothing was pushed to this position yet */
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef LAB0_CQUEUE_H
+#define LAB0_CQUEUE_H
+
+/* This program implements a bounded queue of elements that any number of
+ * threads may push to and pop from concurrently, without locks.
+ *
+ * It uses a ring of cells, each tagged with a sequence number telling which
+ * lap of the ring the cell is ready for (Dmitry Vyukov's bounded MPMC queue).
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "queue.h"
+
+typedef struct cqueue cqueue_t;
+
+/**
+ * cq_new() - Create an empty concurrent queue
+ * @capacity: number of elements the queue can hold, rounded up to a power of 2
+ * no less than 2
+ *
+ * The ring is allocated here and never resized, so the queue does not need
+ * any memory reclamation scheme: cells are reused in place and an element is
+ * owned by whoever popped it.
+ *
+ * Return: NULL for allocation failed or zero capacity
+ */
+cqueue_t *cq_new(size_t capacity);
+
+/**
+ * cq_free() - Free the ring, no effect if @q is NULL
+ * @q: concurrent queue
+ *
+ * Elements still in the queue are not released. No other thread may be using
+ * @q when it is freed.
+ */
+void cq_free(cqueue_t *q);
+
+/**
+ * cq_push() - Append an element at the tail, safe to call from any thread
+ * @q: concurrent queue
+ * @e: element to append, owned by the queue until popped
+ *
+ * Return: true for success, false if the queue is full
+ */
+bool cq_push(cqueue_t *q, element_t *e);
+
+/**
+ * cq_pop() - Take the element at the head, safe to call from any thread
+ * @q: concurrent queue
+ *
+ * Elements pushed by one thread are popped in the order they were pushed.
+ *
+ * Return: the element, %NULL if the queue is empty
+ */
+element_t *cq_pop(cqueue_t *q);
+
+#endif /* LAB0_CQUEUE_H */
@@ -6,6 +6,7 @@
 #include "cpucycles.h"
 #include "queue.h"
 #include "random.h"
+#include "ring.h"
 
 /* Maintain a queue independent from the qtest since
  * we do not want the test to affect the original functionality
@@ -36,6 +37,31 @@ static struct list_head *l = NULL;
 
 #define dut_free() ((void) (q_free(l)))
 
+/* The ring is large enough for the longest fill plus one batch. It is only
+ * created once, and emptied between measurements.
+ */
+#define RING_DUT_CAPACITY 16384
+#define RING_DUT_BATCH 8
+
+static ring_t *r = NULL;
+
+#define dut_ring_new()                                             \
+    do {                                                           \
+        if (!r)                                                    \
+            r = ring_new(RING_DUT_CAPACITY);                       \
+        if (r)                                                     \
+            ring_remove_head_batch(r, NULL, RING_DUT_CAPACITY, 0); \
+    } while (0)
+
+#define dut_ring_insert_tail(s, n)  \
+    do {                            \
+        int j = n;                  \
+        while (j--)                 \
+            ring_insert_tail(r, s); \
+    } while (0)
+
+#define dut_ring_free() ((void) (ring_free(r), r = NULL))
+
 static char random_string[N_MEASURES][8];
 static int random_string_iter = 0;
 
@@ -73,7 +99,8 @@ bool measure(int64_t *before_ticks,
              int mode)
 {
     assert(mode == DUT(insert_head) || mode == DUT(insert_tail) ||
-           mode == DUT(remove_head) || mode == DUT(remove_tail));
+           mode == DUT(remove_head) || mode == DUT(remove_tail) ||
+           mode == DUT(ring_insert_tail) || mode == DUT(ring_remove_head));
 
     switch (mode) {
     case DUT(insert_head):
@@ -146,6 +173,54 @@ bool measure(int64_t *before_ticks,
                 return false;
         }
         break;
+    case DUT(ring_insert_tail):
+        for (size_t i = DROP_SIZE; i < N_MEASURES - DROP_SIZE; i++) {
+            char *batch[RING_DUT_BATCH];
+            for (int k = 0; k < RING_DUT_BATCH; k++)
+                batch[k] = get_random_string();
+            dut_ring_new();
+            if (!r)
+                return false;
+            dut_ring_insert_tail(
+                get_random_string(),
+                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000);
+            size_t before_size = ring_size(r);
+            before_ticks[i] = cpucycles();
+            size_t n = ring_insert_tail_batch(r, batch, RING_DUT_BATCH);
+            after_ticks[i] = cpucycles();
+            size_t after_size = ring_size(r);
+            if (n != RING_DUT_BATCH || before_size + n != after_size) {
+                dut_ring_free();
+                return false;
+            }
+        }
+        dut_ring_free();
+        break;
+    case DUT(ring_remove_head):
+        for (size_t i = DROP_SIZE; i < N_MEASURES - DROP_SIZE; i++) {
+            char bufs[RING_DUT_BATCH][8];
+            char *sp[RING_DUT_BATCH];
+            for (int k = 0; k < RING_DUT_BATCH; k++)
+                sp[k] = bufs[k];
+            dut_ring_new();
+            if (!r)
+                return false;
+            dut_ring_insert_tail(
+                get_random_string(),
+                *(uint16_t *) (input_data + i * CHUNK_SIZE) % 10000 +
+                    RING_DUT_BATCH);
+            size_t before_size = ring_size(r);
+            before_ticks[i] = cpucycles();
+            size_t n = ring_remove_head_batch(r, sp, RING_DUT_BATCH, 8);
+            after_ticks[i] = cpucycles();
+            size_t after_size = ring_size(r);
+            if (n != RING_DUT_BATCH || before_size != after_size + n) {
+                dut_ring_free();
+                return false;
+            }
+        }
+        dut_ring_free();
+        break;
     default:
         for (size_t i = DROP_SIZE; i < N_MEASURES - DROP_SIZE; i++) {
             dut_new();
@@ -12,11 +12,13 @@
 
 #define DROP_SIZE 20
 
-#define DUT_FUNCS  \
-    _(insert_head) \
-    _(insert_tail) \
-    _(remove_head) \
-    _(remove_tail)
+#define DUT_FUNCS       \
+    _(insert_head)      \
+    _(insert_tail)      \
+    _(remove_head)      \
+    _(remove_tail)      \
+    _(ring_insert_tail) \
+    _(ring_remove_head)
 
 #define DUT(x) DUT_##x
 
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <unistd.h>
 
 #include "report.h"
@@ -25,25 +26,117 @@
 /* Value at end of every block */
 #define MAGICFOOTER 0xbeefdead
 
+/* Value at start of every block taken from an arena */
+#define MAGICARENA 0xa7e9a7e9
+
 /* Byte to fill newly malloced space with */
 #define FILLCHAR 0x55
 
 /* Data structures used by our code */
 
-/* Represent allocated blocks as doubly-linked list, with
- * next and prev pointers at beginning
+/* Header placed in front of every allocated block. Live blocks are tracked by
+ * the hash set below, and next only links blocks sitting in a pool free list.
  */
 typedef struct __block_element {
-    struct __block_element *next, *prev;
+    struct __block_element *next;
     size_t payload_size;
+    size_t reserved;     /* Keep the payload 16-byte aligned */
     size_t magic_header; /* Marker to see if block seems legitimate */
     unsigned char payload[0];
     /* Also place magic number at tail of every block */
 } block_element_t;
 
-static block_element_t *allocated = NULL;
 static size_t allocated_count = 0;
 
+/* Set of live blocks, using open addressing with linear probing. Freed slots
+ * become tombstones so that probe sequences of other blocks stay intact, and
+ * the table is rebuilt whenever live entries plus tombstones exceed 3/4 of it.
+ */
+#define TABLE_MIN_SIZE 1024
+#define TOMBSTONE ((block_element_t *) 1)
+
+static block_element_t **table = NULL;
+static size_t table_size = 0; /* Number of slots, always a power of 2 */
+static size_t table_used = 0; /* Live entries plus tombstones */
+
+/* Small blocks (header, payload and footer included) are carved out of large
+ * mmap'ed chunks instead of going through malloc one by one. Each size class
+ * keeps a free list threaded through the 'next' field of released blocks, so
+ * the header/footer checks below work exactly as for malloc'ed blocks.
+ */
+#define POOL_ALIGN 16
+#define POOL_MAX_BLOCK 256
+#define POOL_CLASSES (POOL_MAX_BLOCK / POOL_ALIGN)
+
+/* Chunks start small and double in size up to the limit */
+#define POOL_MIN_CHUNK (64 * 1024)
+#define POOL_MAX_CHUNK (16 * 1024 * 1024)
+
+typedef struct __pool_chunk {
+    struct __pool_chunk *next;
+    size_t size;
+} pool_chunk_t;
+
+typedef struct {
+    block_element_t *free_list;
+    char *cur, *end;   /* Unused space left in the newest chunk */
+    size_t chunk_size; /* Size of the next chunk to map */
+} pool_class_t;
+
+static pool_class_t pools[POOL_CLASSES];
+static pool_chunk_t *pool_chunks = NULL;
+
+/* Arena blocks only carry a short header, whose magic sits right in front of
+ * the payload like the one of a block_element_t, so that test_free() can tell
+ * them apart. Their memory is not recycled until the whole arena is freed.
+ */
+#define ARENA_ALIGN 16
+#define ARENA_MIN_CHUNK (4 * 1024)
+
+typedef struct {
+    struct test_arena *arena;
+    size_t magic_header;
+    unsigned char payload[0];
+} arena_header_t;
+
+struct test_arena {
+    pool_chunk_t *chunks;
+    char *cur, *end;         /* Unused space left in the newest chunk */
+    size_t chunk_size;       /* Size of the next chunk to allocate */
+    size_t live;             /* Blocks handed out and not released */
+    struct test_arena *next; /* Arenas merged into this one */
+    struct test_arena *link; /* Next live arena, from arenas */
+};
+
+/* Number of live arena blocks, over all arenas */
+static size_t arena_count = 0;
+
+/* Every arena not freed yet, merged or not */
+static struct test_arena *arenas = NULL;
+
+/* Whether p may be the payload of a block carved out of a live arena */
+static bool arena_owns(const void *p)
+{
+    const char *h = (const char *) p - sizeof(arena_header_t);
+    for (const test_arena_t *a = arenas; a; a = a->link) {
+        for (const pool_chunk_t *c = a->chunks; c; c = c->next) {
+            if (h >= (const char *) (c + 1) && h < (const char *) c + c->size)
+                return true;
+        }
+    }
+    return false;
+}
+
+/* Account for the release of an arena block, whose memory itself is only
+ * reclaimed along with the arena
+ */
+static void arena_release(arena_header_t *h)
+{
+    h->magic_header = MAGICFREE;
+    h->arena->live--;
+    arena_count--;
+}
+
 /* Percent probability of malloc failure */
 int fail_probability = 0;
 
@@ -63,6 +156,7 @@ static bool time_limited = false;
 typedef enum {
     TEST_MALLOC,
     TEST_CALLOC,
+    TEST_ARENA,
 } alloc_t;
 
 /* Internal functions */
@@ -74,6 +168,93 @@ static bool fail_allocation()
     return (weight < 0.01 * fail_probability);
 }
 
+static inline size_t table_hash(const block_element_t *b)
+{
+    /* Blocks are 16-byte aligned. Neighbouring blocks of a pool chunk land in
+     * neighbouring slots, which keeps probing cache friendly, while folding in
+     * the high bits spreads separate chunks over the table.
+     */
+    uintptr_t h = (uintptr_t) b >> 4;
+    return (size_t) (h ^ (h >> 20)) & (table_size - 1);
+}
+
+/* Return slot holding b, or table_size if b is not a live block */
+static size_t table_find(const block_element_t *b)
+{
+    if (!table)
+        return table_size;
+
+    for (size_t i = table_hash(b);; i = (i + 1) & (table_size - 1)) {
+        if (table[i] == b)
+            return i;
+        if (!table[i])
+            return table_size;
+    }
+}
+
+/* Rebuild the table for allocated_count live blocks, dropping tombstones */
+static void table_resize()
+{
+    size_t new_size = TABLE_MIN_SIZE;
+    while (new_size < allocated_count * 4)
+        new_size <<= 1;
+
+    /* Hold the time limit off until the blocks are all in the new table */
+    sigset_t set, old_set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    sigprocmask(SIG_BLOCK, &set, &old_set);
+
+    block_element_t **fresh = calloc(new_size, sizeof(block_element_t *));
+    if (!fresh) {
+        sigprocmask(SIG_SETMASK, &old_set, NULL);
+        report_event(MSG_FATAL, "Couldn't allocate any more memory");
+        return;
+    }
+
+    block_element_t **old = table;
+    size_t old_size = table_size;
+    table = fresh;
+    table_size = new_size;
+    table_used = 0;
+
+    for (size_t i = 0; i < old_size; i++) {
+        block_element_t *b = old[i];
+        if (!b || b == TOMBSTONE)
+            continue;
+        size_t j = table_hash(b);
+        while (table[j])
+            j = (j + 1) & (table_size - 1);
+        table[j] = b;
+        table_used++;
+    }
+    free(old);
+    sigprocmask(SIG_SETMASK, &old_set, NULL);
+}
+
+static void table_insert(block_element_t *b)
+{
+    if ((table_used + 1) * 4 > table_size * 3)
+        table_resize();
+
+    size_t i = table_hash(b);
+    while (table[i] && table[i] != TOMBSTONE)
+        i = (i + 1) & (table_size - 1);
+    if (!table[i])
+        table_used++;
+    table[i] = b;
+}
+
+/* Forget b. Return false if it was not a live block. */
+static bool table_remove(const block_element_t *b)
+{
+    size_t i = table_find(b);
+    if (i == table_size)
+        return false;
+    table[i] = TOMBSTONE;
+    return true;
+}
+
 /* Find header of block, given its payload.
  * Signal error if doesn't seem like legitimate block
  */
@@ -88,13 +269,7 @@ static block_element_t *find_header(void *p)
         (block_element_t *) ((size_t) p - sizeof(block_element_t));
     if (cautious_mode) {
         /* Make sure this is really an allocated block */
-        block_element_t *ab = allocated;
-        bool found = false;
-        while (ab && !found) {
-            found = ab == b;
-            ab = ab->next;
-        }
-        if (!found) {
+        if (table_find(b) == table_size) {
             report_event(MSG_ERROR,
                          "Attempted to free unallocated block.  Address = %p",
                          p);
@@ -113,6 +288,61 @@ static block_element_t *find_header(void *p)
     return b;
 }
 
+/* Total size of a block holding size bytes of payload */
+static inline size_t block_size(size_t size)
+{
+    return size + sizeof(block_element_t) + sizeof(size_t);
+}
+
+/* Get a block of total size bsize from the pool, NULL if out of memory */
+static block_element_t *pool_alloc(size_t bsize)
+{
+    pool_class_t *pc = &pools[(bsize - 1) / POOL_ALIGN];
+    block_element_t *b = pc->free_list;
+    if (b) {
+        pc->free_list = b->next;
+        return b;
+    }
+
+    bsize = ((bsize - 1) / POOL_ALIGN + 1) * POOL_ALIGN;
+    if ((size_t) (pc->end - pc->cur) < bsize) {
+        size_t csize = pc->chunk_size ? pc->chunk_size : POOL_MIN_CHUNK;
+        pool_chunk_t *c = mmap(NULL, csize, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (c == MAP_FAILED)
+            return NULL;
+        c->next = pool_chunks;
+        c->size = csize;
+        pool_chunks = c;
+        pc->cur = (char *) (c + 1);
+        pc->end = (char *) c + csize;
+        pc->chunk_size = csize < POOL_MAX_CHUNK ? csize * 2 : csize;
+    }
+
+    b = (block_element_t *) pc->cur;
+    pc->cur += bsize;
+    return b;
+}
+
+/* Return a block of total size bsize to its free list */
+static void pool_free(block_element_t *b, size_t bsize)
+{
+    pool_class_t *pc = &pools[(bsize - 1) / POOL_ALIGN];
+    b->next = pc->free_list;
+    pc->free_list = b;
+}
+
+/* Unmap every chunk. Only valid once no pooled block is in use. */
+static void pool_release()
+{
+    while (pool_chunks) {
+        pool_chunk_t *c = pool_chunks;
+        pool_chunks = c->next;
+        munmap(c, c->size);
+    }
+    memset(pools, 0, sizeof(pools));
+}
+
 /* Given pointer to block, find its footer */
 static size_t *find_footer(block_element_t *b)
 {
@@ -122,28 +352,39 @@ static size_t *find_footer(block_element_t *b)
     return p;
 }
 
-static void *alloc(alloc_t alloc_type, size_t size)
+/* Should this allocation be refused, either by mode or by chance? */
+static bool alloc_refused(alloc_t alloc_type)
 {
     if (noallocate_mode) {
         char *msg_alloc_forbidden[] = {
             "Calls to malloc are disallowed",
             "Calls to calloc are disallowed",
+            "Arena allocations are disallowed",
         };
         report_event(MSG_FATAL, "%s", msg_alloc_forbidden[alloc_type]);
-        return NULL;
+        return true;
     }
 
     if (fail_allocation()) {
         char *msg_alloc_failure[] = {
             "Malloc returning NULL",
             "Calloc returning NULL",
+            "Arena allocation returning NULL",
         };
         report_event(MSG_WARN, "%s", msg_alloc_failure[alloc_type]);
-        return NULL;
+        return true;
     }
+    return false;
+}
+
+static void *alloc(alloc_t alloc_type, size_t size)
+{
+    if (alloc_refused(alloc_type))
+        return NULL;
 
+    size_t bsize = block_size(size);
     block_element_t *new_block =
-        malloc(size + sizeof(block_element_t) + sizeof(size_t));
+        bsize <= POOL_MAX_BLOCK ? pool_alloc(bsize) : malloc(bsize);
     if (!new_block) {
         report_event(MSG_FATAL, "Couldn't allocate any more memory");
         error_occurred = true;
@@ -156,15 +397,8 @@ static void *alloc(alloc_t alloc_type, size_t size)
     *find_footer(new_block) = MAGICFOOTER;
     void *p = (void *) &new_block->payload;
     memset(p, !alloc_type * FILLCHAR, size);
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->next = allocated;
-    // cppcheck-suppress nullPointerRedundantCheck
-    new_block->prev = NULL;
-
-    if (allocated)
-        allocated->prev = new_block;
-    allocated = new_block;
     allocated_count++;
+    table_insert(new_block);
 
     return p;
 }
@@ -197,7 +431,20 @@ void test_free(void *p)
     if (!p)
         return;
 
-    block_element_t *b = find_header(p);
+    /* In cautious mode, only look at the header of an arena block once p is
+     * known to lie in a live arena, and not in the block table
+     */
+    arena_header_t *h = (arena_header_t *) p - 1;
+    block_element_t *b =
+        (block_element_t *) ((size_t) p - sizeof(block_element_t));
+    bool in_arena =
+        !cautious_mode || (table_find(b) == table_size && arena_owns(p));
+    if (in_arena && h->magic_header == MAGICARENA) {
+        arena_release(h);
+        return;
+    }
+
+    b = find_header(p);
     size_t footer = *find_footer(b);
     if (footer != MAGICFOOTER) {
         report_event(MSG_ERROR,
@@ -206,22 +453,27 @@ void test_free(void *p)
                      p);
         error_occurred = true;
     }
+    /* Never recycle a block that is not live, e.g. on a double free */
+    if (!table_remove(b))
+        return;
+
     b->magic_header = MAGICFREE;
     *find_footer(b) = MAGICFREE;
     memset(p, FILLCHAR, b->payload_size);
 
-    /* Unlink from list */
-    block_element_t *bn = b->next;
-    block_element_t *bp = b->prev;
-    if (bp)
-        bp->next = bn;
+    size_t bsize = block_size(b->payload_size);
+    if (bsize <= POOL_MAX_BLOCK)
+        pool_free(b, bsize);
     else
-        allocated = bn;
-    if (bn)
-        bn->prev = bp;
-
-    free(b);
-    allocated_count--;
+        free(b);
+
+    /* Hand the chunks back to the system once everything has been freed */
+    if (!--allocated_count) {
+        pool_release();
+        free(table);
+        table = NULL;
+        table_size = table_used = 0;
+    }
 }
 
 // cppcheck-suppress unusedFunction
@@ -237,7 +489,105 @@ char *test_strdup(const char *s)
 
 size_t allocation_check()
 {
-    return allocated_count;
+    return allocated_count + arena_count;
+}
+
+test_arena_t *test_arena_new(void)
+{
+    if (alloc_refused(TEST_ARENA))
+        return NULL;
+
+    test_arena_t *a = calloc(1, sizeof(test_arena_t));
+    if (!a) {
+        report_event(MSG_FATAL, "Couldn't allocate any more memory");
+        error_occurred = true;
+        return NULL;
+    }
+    a->chunk_size = ARENA_MIN_CHUNK;
+    a->link = arenas;
+    arenas = a;
+    return a;
+}
+
+void *test_arena_alloc(test_arena_t *a, size_t size)
+{
+    if (alloc_refused(TEST_ARENA))
+        return NULL;
+
+    size_t asize = sizeof(arena_header_t) +
+                   (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+    if ((size_t) (a->end - a->cur) < asize) {
+        size_t csize = a->chunk_size;
+        while (csize < sizeof(pool_chunk_t) + asize)
+            csize *= 2;
+        pool_chunk_t *c = malloc(csize);
+        if (!c) {
+            report_event(MSG_FATAL, "Couldn't allocate any more memory");
+            error_occurred = true;
+            return NULL;
+        }
+        c->next = a->chunks;
+        c->size = csize;
+        a->chunks = c;
+        a->cur = (char *) (c + 1);
+        a->end = (char *) c + csize;
+        a->chunk_size = csize < POOL_MAX_CHUNK ? csize * 2 : csize;
+    }
+
+    arena_header_t *h = (arena_header_t *) a->cur;
+    a->cur += asize;
+    h->arena = a;
+    h->magic_header = MAGICARENA;
+    a->live++;
+    arena_count++;
+    memset(h->payload, FILLCHAR, size);
+    return h->payload;
+}
+
+void test_arena_release(void *p)
+{
+    if (!p)
+        return;
+
+    arena_header_t *h = (arena_header_t *) p - 1;
+    if (!arena_owns(p) || h->magic_header != MAGICARENA) {
+        report_event(MSG_ERROR,
+                     "Attempted to release a block not taken from an arena.  "
+                     "Address = %p",
+                     p);
+        error_occurred = true;
+        return;
+    }
+    arena_release(h);
+}
+
+void test_arena_merge(test_arena_t *a, test_arena_t *other)
+{
+    /* Blocks of other still point at it, so it is kept on a's chain */
+    while (a->next)
+        a = a->next;
+    a->next = other;
+}
+
+void test_arena_free(test_arena_t *a)
+{
+    while (a) {
+        test_arena_t *next = a->next;
+        for (test_arena_t **pp = &arenas; *pp; pp = &(*pp)->link) {
+            if (*pp == a) {
+                *pp = a->link;
+                break;
+            }
+        }
+        arena_count -= a->live;
+        while (a->chunks) {
+            pool_chunk_t *c = a->chunks;
+            a->chunks = c->next;
+            free(c);
+        }
+        free(a);
+        a = next;
+    }
 }
 
 /* Implementation of functions for testing */
@@ -294,6 +644,13 @@ bool exception_setup(bool limit_time)
     return true;
 }
 
+/* Restart the time limit of risky code */
+void exception_rearm()
+{
+    if (time_limited)
+        alarm(time_limit);
+}
+
 /* Call once past risky code */
 void exception_cancel()
 {
@@ -8,6 +8,7 @@
 /* This test harness enables us to do stringent testing of code.
  * It overloads the library versions of malloc and free with ones that
  * allow checking for common allocation errors.
+ * Small blocks are served from pooled chunks rather than one malloc each.
  */
 
 void *test_malloc(size_t size);
@@ -16,9 +17,24 @@ void test_free(void *p);
 char *test_strdup(const char *s);
 /* FIXME: provide test_realloc as well */
 
+/* Arenas hand out blocks by bumping a pointer through large chunks, and give
+ * all of them back at once when freed. A block taken from an arena may still
+ * be passed to test_free, which then only accounts for it.
+ */
+typedef struct test_arena test_arena_t;
+
+test_arena_t *test_arena_new(void);
+void *test_arena_alloc(test_arena_t *a, size_t size);
+/* Give back a block taken from an arena, no effect if p is NULL */
+void test_arena_release(void *p);
+/* Make a responsible for the blocks of other, which must not be used again */
+void test_arena_merge(test_arena_t *a, test_arena_t *other);
+/* Release every block of the arena, no effect if a is NULL */
+void test_arena_free(test_arena_t *a);
+
 #ifdef INTERNAL
 
-/* Report number of allocated blocks */
+/* Report number of allocated blocks, arena blocks not yet released included */
 size_t allocation_check();
 
 /* Probability of malloc failing, expressed as percent */
@@ -47,6 +63,11 @@ bool exception_setup(bool limit_time);
 /* Call once past risky code */
 void exception_cancel();
 
+/* Give the risky code the whole time limit again, as if it had just been set
+ * up. No effect without a time limit
+ */
+void exception_rearm();
+
 /* Use longjmp to return to most recent exception setup.  Include error message
  */
 void trigger_exception(char *msg);
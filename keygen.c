@@ -0,0 +1,151 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keygen.h"
+
+/* Zipf keys are drawn among at most this many distinct ones */
+#define ZIPF_MAX_RANKS (1 << 20)
+
+typedef struct {
+    uint64_t rng;
+    double *cdf; /* Cumulative weights of the Zipf ranks */
+    size_t ranks;
+} keygen_state_t;
+
+struct keygen_dist {
+    const char *name;
+    void (*gen)(keygen_state_t *st, char *buf);
+    int order;      /* 1 sorted ascending, -1 descending, 0 as generated */
+    unsigned swaps; /* Random pairs swapped per thousand keys, once sorted */
+};
+
+/* xorshift64* */
+static uint64_t rng_next(keygen_state_t *st)
+{
+    st->rng ^= st->rng >> 12;
+    st->rng ^= st->rng << 25;
+    st->rng ^= st->rng >> 27;
+    return st->rng * 0x2545f4914f6cdd1dULL;
+}
+
+static void key_random(keygen_state_t *st, char *buf)
+{
+    size_t len = 5 + rng_next(st) % 12;
+    for (size_t j = 0; j < len; j++)
+        buf[j] = 'a' + rng_next(st) % 26;
+    buf[len] = '\0';
+}
+
+/* Only a handful of distinct values, so most comparisons are ties */
+static void key_dup(keygen_state_t *st, char *buf)
+{
+    snprintf(buf, KEYGEN_KEY_MAX, "dup%02u", (unsigned) (rng_next(st) % 64));
+}
+
+/* Keys too long to be stored inline, which only differ past the prefix */
+static void key_prefix(keygen_state_t *st, char *buf)
+{
+    static const char prefix[] = "a-rather-long-prefix-shared-by-all/";
+    memcpy(buf, prefix, sizeof(prefix) - 1);
+    key_random(st, buf + sizeof(prefix) - 1);
+}
+
+/* Rank r comes up with a frequency proportional to 1 / r, as words do in
+ * text. Ranks are spelled as scrambled words, so that their order as strings
+ * has nothing to do with their frequency.
+ */
+static void key_zipf(keygen_state_t *st, char *buf)
+{
+    double u = (rng_next(st) >> 11) * 0x1.0p-53 * st->cdf[st->ranks - 1];
+    size_t lo = 0, hi = st->ranks - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (st->cdf[mid] <= u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    uint64_t h = (lo + 1) * 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 29;
+    for (int j = 0; j < 8; j++, h /= 26)
+        buf[j] = 'a' + h % 26;
+    buf[8] = '\0';
+}
+
+static const keygen_dist_t dists[] = {
+    {"random", key_random, 0, 0}, {"sorted", key_random, 1, 0},
+    {"reverse", key_random, -1, 0}, {"nearly", key_random, 1, 10},
+    {"dup", key_dup, 0, 0},         {"zipf", key_zipf, 0, 0},
+    {"prefix", key_prefix, 0, 0},
+};
+
+#define NR_DISTS (sizeof(dists) / sizeof(dists[0]))
+
+const keygen_dist_t *keygen_dist(size_t i)
+{
+    return i < NR_DISTS ? &dists[i] : NULL;
+}
+
+const keygen_dist_t *keygen_find(const char *name)
+{
+    for (size_t i = 0; i < NR_DISTS; i++) {
+        if (!strcmp(dists[i].name, name))
+            return &dists[i];
+    }
+    return NULL;
+}
+
+const char *keygen_name(const keygen_dist_t *dist)
+{
+    return dist->name;
+}
+
+static int cmp_key(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+static int cmp_key_rev(const void *a, const void *b)
+{
+    return -cmp_key(a, b);
+}
+
+/* Generate keys */
+char *keygen_make(const keygen_dist_t *dist, char **keys, size_t n,
+                  uint64_t seed)
+{
+    keygen_state_t st = {.rng = seed ? seed : 1};
+    if (dist->gen == key_zipf) {
+        st.ranks = n < ZIPF_MAX_RANKS ? (n ? n : 1) : ZIPF_MAX_RANKS;
+        st.cdf = malloc(sizeof(double) * st.ranks);
+        if (!st.cdf)
+            return NULL;
+        double sum = 0;
+        for (size_t r = 0; r < st.ranks; r++)
+            st.cdf[r] = sum += 1.0 / (r + 1);
+    }
+
+    char *pool = malloc(n * KEYGEN_KEY_MAX);
+    if (!pool) {
+        free(st.cdf);
+        return NULL;
+    }
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = pool + i * KEYGEN_KEY_MAX;
+        dist->gen(&st, keys[i]);
+    }
+    free(st.cdf);
+
+    if (dist->order)
+        qsort(keys, n, sizeof(*keys), dist->order > 0 ? cmp_key : cmp_key_rev);
+    for (size_t s = 0; n && s < n * dist->swaps / 1000; s++) {
+        size_t i = rng_next(&st) % n, j = rng_next(&st) % n;
+        char *tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+    return pool;
+}
@@ -0,0 +1,57 @@
+#ifndef LAB0_KEYGEN_H
+#define LAB0_KEYGEN_H
+
+/* This program generates keys to fill queues with, following distributions
+ * that resemble real data more than uniformly random strings do: presorted
+ * input, heavy duplication, skewed frequencies and long shared prefixes.
+ *
+ * Keys only depend on the distribution, the number of keys and the seed, so
+ * qbench, the gen command of qtest and tools/tracegen all agree on them.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Room for any key, including the null terminator */
+#define KEYGEN_KEY_MAX 64
+
+typedef struct keygen_dist keygen_dist_t;
+
+/**
+ * keygen_dist() - Get a distribution by position
+ * @i: position, from 0
+ *
+ * Return: the distribution, NULL past the last one
+ */
+const keygen_dist_t *keygen_dist(size_t i);
+
+/**
+ * keygen_find() - Get a distribution by name
+ * @name: name of the distribution
+ *
+ * Return: the distribution, NULL if there is none called @name
+ */
+const keygen_dist_t *keygen_find(const char *name);
+
+/**
+ * keygen_name() - Get the name of a distribution
+ * @dist: distribution
+ */
+const char *keygen_name(const keygen_dist_t *dist);
+
+/**
+ * keygen_make() - Generate keys
+ * @dist: distribution
+ * @keys: array of @n pointers, set to the keys in insertion order
+ * @n: number of keys
+ * @seed: seed of the generator, 0 standing for 1
+ *
+ * The keys are stored in one block of @n * KEYGEN_KEY_MAX bytes, which the
+ * caller releases with free() once done with them.
+ *
+ * Return: the block, NULL for allocation failed
+ */
+char *keygen_make(const keygen_dist_t *dist, char **keys, size_t n,
+                  uint64_t seed);
+
+#endif /* LAB0_KEYGEN_H */
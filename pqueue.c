@@ -0,0 +1,157 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "pqueue.h"
+
+/* The links of an element in a heap, NULL where there is none */
+static inline element_t *pq_child(const element_t *e)
+{
+    return e->list.prev ? list_entry(e->list.prev, element_t, list) : NULL;
+}
+
+static inline element_t *pq_sibling(const element_t *e)
+{
+    return e->list.next ? list_entry(e->list.next, element_t, list) : NULL;
+}
+
+static inline void pq_set_child(element_t *e, element_t *child)
+{
+    e->list.prev = child ? &child->list : NULL;
+}
+
+static inline void pq_set_sibling(element_t *e, element_t *sibling)
+{
+    e->list.next = sibling ? &sibling->list : NULL;
+}
+
+/* Link two trees, the root with the greater string becoming the first child
+ * of the other one. Ties keep @a on top.
+ */
+static element_t *pq_link(element_t *a, element_t *b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+    if (strcmp(b->value, a->value) < 0) {
+        element_t *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    pq_set_sibling(b, pq_child(a));
+    pq_set_child(a, b);
+    return a;
+}
+
+/* Create an empty heap */
+pqueue_t *pq_new(void)
+{
+    pqueue_t *pq = malloc(sizeof(pqueue_t));
+    if (!pq)
+        return NULL;
+    pq->root = NULL;
+    pq->size = 0;
+    return pq;
+}
+
+/* Free the heap and release all its elements */
+void pq_free(pqueue_t *pq)
+{
+    if (!pq)
+        return;
+
+    /* Elements left to release, linked through their sibling links. The
+     * children of each element join them as it is released.
+     */
+    element_t *pending = pq->root;
+    while (pending) {
+        element_t *e = pending;
+        pending = pq_sibling(e);
+
+        element_t *child = pq_child(e);
+        if (child) {
+            element_t *last = child;
+            while (pq_sibling(last))
+                last = pq_sibling(last);
+            pq_set_sibling(last, pending);
+            pending = child;
+        }
+        q_release_element(e);
+    }
+    free(pq);
+}
+
+/* Add an element to the heap */
+void pq_push(pqueue_t *pq, element_t *e)
+{
+    pq_set_child(e, NULL);
+    pq_set_sibling(e, NULL);
+    pq->root = pq_link(pq->root, e);
+    pq->size++;
+}
+
+/* Move every element of a queue into the heap */
+bool pq_push_queue(pqueue_t *pq, struct list_head *head)
+{
+    if (!head || q_head(head)->arena)
+        return false;
+
+    /* The index would point at elements which are no longer in the queue */
+    q_index_drop(head);
+
+    element_t *entry, *safe;
+    list_for_each_entry_safe(entry, safe, head, list)
+        pq_push(pq, entry);
+    INIT_LIST_HEAD(head);
+    q_head(head)->size = 0;
+    return true;
+}
+
+/* Remove the element holding the least string */
+element_t *pq_pop_min(pqueue_t *pq)
+{
+    if (!pq || !pq->root)
+        return NULL;
+
+    element_t *min = pq->root;
+
+    /* First pass: link the subtrees two by two from left to right, stacking
+     * up the results through their sibling links.
+     */
+    element_t *pairs = NULL, *e = pq_child(min);
+    while (e) {
+        element_t *b = pq_sibling(e), *next = b ? pq_sibling(b) : NULL;
+        pq_set_sibling(e, NULL);
+        if (b)
+            pq_set_sibling(b, NULL);
+        element_t *pair = pq_link(e, b);
+        pq_set_sibling(pair, pairs);
+        pairs = pair;
+        e = next;
+    }
+
+    /* Second pass: link them into a single tree from right to left */
+    element_t *root = NULL;
+    while (pairs) {
+        element_t *next = pq_sibling(pairs);
+        pq_set_sibling(pairs, NULL);
+        root = pq_link(root, pairs);
+        pairs = next;
+    }
+
+    pq->root = root;
+    pq->size--;
+    INIT_LIST_HEAD(&min->list);
+    return min;
+}
+
+/* Move all elements of a heap into another one */
+void pq_meld(pqueue_t *pq, pqueue_t *other)
+{
+    if (!pq || !other || pq == other)
+        return;
+    pq->root = pq_link(pq->root, other->root);
+    pq->size += other->size;
+    other->root = NULL;
+    other->size = 0;
+}
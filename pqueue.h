@@ -0,0 +1,104 @@
+#ifndef LAB0_PQUEUE_H
+#define LAB0_PQUEUE_H
+
+/* This program implements a priority queue of strings, which always hands out
+ * the least string first.
+ *
+ * It is a pairing heap whose nodes are the elements of queue.h themselves:
+ * the links of an element in a heap point at its first child (list.prev) and
+ * at its next sibling (list.next) instead of at its neighbours in a list. An
+ * element can thus move between a queue and a heap without being copied.
+ */
+
+#include <stdbool.h>
+
+#include "queue.h"
+
+/**
+ * pqueue_t - Pairing heap of elements
+ * @root: element holding the least string, NULL if the heap is empty
+ * @size: number of elements in the heap
+ */
+typedef struct {
+    element_t *root;
+    int size;
+} pqueue_t;
+
+/**
+ * pq_new() - Create an empty heap
+ *
+ * Return: NULL for allocation failed
+ */
+pqueue_t *pq_new(void);
+
+/**
+ * pq_free() - Free the heap and release all its elements, no effect if @pq is
+ * NULL
+ * @pq: heap
+ */
+void pq_free(pqueue_t *pq);
+
+/**
+ * pq_push() - Add an element to the heap in O(1)
+ * @pq: heap
+ * @e: element which is not in any queue or heap, owned by the heap until it
+ * is popped
+ */
+void pq_push(pqueue_t *pq, element_t *e);
+
+/**
+ * pq_push_queue() - Move every element of a queue into the heap
+ * @pq: heap
+ * @head: queue created by q_new(), left empty
+ *
+ * Takes O(n) for n elements. Elements of a queue from q_new_arena() go away
+ * with its arena, so such a queue is refused.
+ *
+ * Return: true for success, false if @head is NULL or from q_new_arena(), in
+ * which case it is left unchanged
+ */
+bool pq_push_queue(pqueue_t *pq, struct list_head *head);
+
+/**
+ * pq_peek() - Get the element holding the least string, leaving it in place
+ * @pq: heap
+ *
+ * Return: the element, %NULL if the heap is NULL or empty
+ */
+static inline element_t *pq_peek(const pqueue_t *pq)
+{
+    return pq ? pq->root : NULL;
+}
+
+/**
+ * pq_pop_min() - Remove the element holding the least string
+ * @pq: heap
+ *
+ * Among equal strings, which one comes first is unspecified. The remaining
+ * subtrees are paired up from left to right, then merged from right to left,
+ * which takes O(log n) amortized time.
+ *
+ * Return: the element, now owned by the caller, %NULL if the heap is NULL or
+ * empty
+ */
+element_t *pq_pop_min(pqueue_t *pq);
+
+/**
+ * pq_meld() - Move all elements of a heap into another one in O(1)
+ * @pq: heap receiving the elements
+ * @other: heap left empty
+ */
+void pq_meld(pqueue_t *pq, pqueue_t *other);
+
+/**
+ * pq_size() - Get the number of elements in the heap
+ * @pq: heap
+ *
+ * Return: the number of elements, zero if the heap is NULL or empty
+ */
+static inline int pq_size(const pqueue_t *pq)
+{
+    return pq ? pq->size : 0;
+}
+
+#endif /* LAB0_PQUEUE_H */
@@ -3,8 +3,12 @@
 #include <assert.h>
 #include <errno.h>
 #include <getopt.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <spawn.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -44,7 +48,12 @@ extern int show_entropy;
  */
 #include "queue.h"
 
+#include "btrace.h"
 #include "console.h"
+#include "cqueue.h"
+#include "keygen.h"
+#include "pqueue.h"
+#include "ring.h"
 #include "report.h"
 
 /* Settable parameters */
@@ -53,7 +62,6 @@ extern int show_entropy;
 
 /* How large is a queue before it's considered big.
  * This affects how it gets printed
- * and whether cautious mode is used when freeing the queue
  */
 #define BIG_LIST_SIZE 30
 
@@ -75,6 +83,24 @@ static int string_length = MAXSTRING;
 
 static int descend = 0;
 
+/* Use q_sort_key instead of q_sort */
+static int sort_key = 0;
+
+/* Use q_sort_parallel with this many threads when above 1 */
+static int sort_threads = 1;
+
+/* Use q_merge_pairwise instead of q_merge */
+static int merge_pairwise = 0;
+
+/* Use q_shuffle_merge instead of q_shuffle */
+static int shuffle_merge = 0;
+
+/* Use q_delete_dup_hash instead of q_delete_dup */
+static int dedup_hash = 0;
+
+/* Create queues with q_new_arena instead of q_new */
+static int arena = 0;
+
 #define MIN_RANDSTR_LEN 5
 #define MAX_RANDSTR_LEN 10
 static const char charset[] = "abcdefghijklmnopqrstuvwxyz";
@@ -83,6 +109,11 @@ typedef enum {
     POS_TAIL,
     POS_HEAD,
 } position_t;
+/* Heap of the pq_* commands, created by the first push or meld and released
+ * once empty
+ */
+static pqueue_t *heap = NULL;
+
 /* Forward declarations */
 static bool q_show(int vlevel);
 
@@ -101,9 +132,6 @@ static bool do_free(int argc, char *argv[])
     }
     error_check();
 
-    if (current && current->size > BIG_LIST_SIZE)
-        set_cautious_mode(false);
-
     struct list_head *qnext = NULL;
     if (chain.size > 1) {
         qnext = (current->chain.next == &chain.head) ? chain.head.next
@@ -116,7 +144,6 @@ static bool do_free(int argc, char *argv[])
         if (exception_setup(true))
             q_free(current->q);
         exception_cancel();
-        set_cautious_mode(true);
     }
 
     if (current) {
@@ -127,8 +154,9 @@ static bool do_free(int argc, char *argv[])
 
     q_show(3);
 
+    /* Elements still in the heap of the pq_* commands are accounted for */
     size_t bcnt = allocation_check();
-    if (!chain.size && bcnt > 0) {
+    if (!chain.size && !heap && bcnt > 0) {
         report(1,
                "ERROR: There is no queue, but %lu blocks are still allocated",
                bcnt);
@@ -152,7 +180,7 @@ static bool do_new(int argc, char *argv[])
         list_add_tail(&qctx->chain, &chain.head);
 
         qctx->size = 0;
-        qctx->q = q_new();
+        qctx->q = arena ? q_new_arena() : q_new();
         qctx->id = chain.size++;
 
         current = qctx;
@@ -188,6 +216,74 @@ static bool fill_rand_string(char *buf, size_t buf_size)
     return true;
 }
 
+/* Insert reps copies of s, or reps random strings if s is NULL, with a single
+ * batch insertion. *done is cleared when the batch could not be allocated,
+ * which leaves the queue untouched.
+ */
+static bool queue_insert_many(position_t pos, char *s, int reps, bool *done)
+{
+    *done = true;
+    char **strs = malloc(sizeof(char *) * reps);
+    char *rands = s ? NULL : malloc((size_t) MAX_RANDSTR_LEN * reps);
+    if (!strs || (!s && !rands)) {
+        report(1, "INTERNAL ERROR.  Could not allocate space for %d strings",
+               reps);
+        free(strs);
+        free(rands);
+        return false;
+    }
+
+    bool ok = true;
+    for (int r = 0; ok && r < reps; r++) {
+        strs[r] = s ? s : rands + (size_t) r * MAX_RANDSTR_LEN;
+        if (!s)
+            ok = fill_rand_string(strs[r], MAX_RANDSTR_LEN);
+    }
+
+    bool inserted = false;
+    if (ok && exception_setup(true)) {
+        inserted = pos == POS_TAIL ? q_insert_tail_many(current->q, strs, reps)
+                                   : q_insert_head_many(current->q, strs, reps);
+    }
+    exception_cancel();
+
+    if (inserted) {
+        current->size += reps;
+        /* Check the last two strings inserted, as queue_insert does */
+        struct list_head *last =
+            pos == POS_TAIL ? current->q->prev : current->q->next;
+        struct list_head *prev = pos == POS_TAIL ? last->prev : last->next;
+        char *cur_inserts = list_entry(last, element_t, list)->value;
+        if (!cur_inserts) {
+            report(1, "ERROR: Failed to save copy of string in queue");
+            ok = false;
+        } else if (cur_inserts == strs[reps - 1]) {
+            report(1,
+                   "ERROR: Need to allocate and copy string for new queue "
+                   "element");
+            ok = false;
+        } else if (cur_inserts == list_entry(prev, element_t, list)->value) {
+            report(1,
+                   "ERROR: Need to allocate separate string for each queue "
+                   "element");
+            ok = false;
+        }
+    } else if (ok && !error_check()) {
+        *done = false;
+    } else {
+        /* Interrupted, with whatever was inserted so far left in the queue */
+        current->size = 0;
+        for (struct list_head *l = current->q->next; l != current->q;
+             l = l->next)
+            current->size++;
+        ok = false;
+    }
+
+    free(strs);
+    free(rands);
+    return ok && !error_check();
+}
+
 /* insertion */
 static bool queue_insert(position_t pos, int argc, char *argv[])
 {
@@ -234,6 +330,19 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
                pos == POS_TAIL ? "tail" : "head");
     error_check();
 
+    /* Bulk loads go through q_insert_*_many. If the batch cannot be
+     * allocated, nothing was inserted and the strings are inserted one at a
+     * time, so that failures are counted per string as before.
+     */
+    if (current && current->q && reps > 1) {
+        bool done;
+        ok = queue_insert_many(pos, need_rand ? NULL : inserts, reps, &done);
+        if (done) {
+            q_show(3);
+            return ok;
+        }
+    }
+
     if (current && exception_setup(true)) {
         for (int r = 0; ok && r < reps; r++) {
             if (need_rand) {
@@ -287,6 +396,67 @@ static bool queue_insert(position_t pos, int argc, char *argv[])
     return ok;
 }
 
+static bool do_gen(int argc, char *argv[])
+{
+    if (argc != 3 && argc != 4) {
+        report(1, "%s needs 2-3 arguments", argv[0]);
+        return false;
+    }
+
+    int n = 0, seed = rand();
+    const keygen_dist_t *dist = keygen_find(argv[1]);
+    if (!dist) {
+        report(1, "Unknown key distribution '%s'", argv[1]);
+        return false;
+    }
+    if (!get_int(argv[2], &n) || n < 1) {
+        report(1, "Invalid number of keys '%s'", argv[2]);
+        return false;
+    }
+    if (argc == 4 && !get_int(argv[3], &seed)) {
+        report(1, "Invalid seed '%s'", argv[3]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling gen on null queue");
+        return false;
+    }
+    error_check();
+
+    char **keys = malloc(sizeof(char *) * n);
+    char *pool = keys ? keygen_make(dist, keys, n, (unsigned) seed) : NULL;
+    if (!pool) {
+        report(1, "INTERNAL ERROR.  Could not allocate space for %d keys", n);
+        free(keys);
+        return false;
+    }
+
+    bool ok = true;
+    if (exception_setup(true)) {
+        for (int i = 0; ok && i < n; i++) {
+            if (q_insert_tail(current->q, keys[i])) {
+                current->size++;
+                continue;
+            }
+            fail_count++;
+            if (fail_count < fail_limit)
+                report(2, "Insertion of %s failed", keys[i]);
+            else {
+                report(1, "ERROR: Insertion of %s failed (%d failures total)",
+                       keys[i], fail_count);
+                ok = false;
+            }
+        }
+    }
+    exception_cancel();
+
+    free(pool);
+    free(keys);
+    q_show(3);
+    return ok && !error_check();
+}
+
 /* insert head */
 static bool do_ih(int argc, char *argv[])
 {
@@ -316,14 +486,25 @@ static bool queue_shuffle(position_t pos, int argc, char *argv[])
         return false;
     }
 
-    set_noallocate_mode(true);
-    if (current && exception_setup(true))
-        q_shuffle(current->q);
+    /* q_shuffle may allocate a node array, but must release it */
+    size_t bcnt = allocation_check();
+    set_noallocate_mode(shuffle_merge);
+    if (current && exception_setup(true)) {
+        if (shuffle_merge)
+            q_shuffle_merge(current->q);
+        else
+            q_shuffle(current->q);
+    }
     exception_cancel();
 
     set_noallocate_mode(false);
+    bool ok = true;
+    if (allocation_check() != bcnt) {
+        report(1, "ERROR: Shuffle did not release its temporary memory");
+        ok = false;
+    }
     q_show(3);
-    return !error_check();
+    return ok && !error_check();
 }
 
 /* shuffle */
@@ -461,6 +642,134 @@ static inline bool do_rt(int argc, char *argv[])
     return queue_remove(POS_TAIL, argc, argv);
 }
 
+/* remove n from head, releasing them as a whole */
+static bool do_rhn(int argc, char *argv[])
+{
+    int n = 0;
+
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+    if (!get_int(argv[1], &n) || n < 0) {
+        report(1, "Invalid number of elements '%s'", argv[1]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling remove head n on null queue");
+        return false;
+    }
+    error_check();
+
+    struct list_head *batch = NULL;
+    if (exception_setup(true))
+        batch = q_remove_head_n(current->q, n);
+    exception_cancel();
+
+    bool ok = true;
+    if (batch) {
+        int expected = n < current->size ? n : current->size;
+        int removed = 0;
+        struct list_head *node;
+        list_for_each(node, batch)
+            removed++;
+
+        if (removed != expected) {
+            report(1, "ERROR: Removed %d elements, expected %d", removed,
+                   expected);
+            ok = false;
+        } else if (q_size(batch) != removed) {
+            report(1, "ERROR: Removed queue reports size %d, but holds %d",
+                   q_size(batch), removed);
+            ok = false;
+        }
+        current->size -= removed;
+        if (q_size(current->q) != current->size) {
+            report(1, "ERROR: Queue size %d after removal, expected %d",
+                   q_size(current->q), current->size);
+            ok = false;
+        }
+        report(2, "Removed %d elements from queue", removed);
+
+        if (exception_setup(true))
+            q_free(batch);
+        exception_cancel();
+    } else {
+        fail_count++;
+        if (fail_count < fail_limit) {
+            report(2, "Removal of %d elements failed", n);
+        } else {
+            report(1, "ERROR: Removal of %d elements failed (%d failures total)",
+                   n, fail_count);
+            ok = false;
+        }
+    }
+
+    q_show(3);
+    return ok && !error_check();
+}
+
+typedef struct {
+    const char *value;
+    bool kept;
+} dedup_ref_t;
+
+static int dedup_ref_cmp(const void *a, const void *b)
+{
+    return strcmp(((const dedup_ref_t *) a)->value,
+                  ((const dedup_ref_t *) b)->value);
+}
+
+/* Check the queue after q_delete_dup_hash against @l_copy, its contents
+ * before. The strings left must be exactly those which occurred once, in
+ * their original order.
+ */
+static bool dedup_hash_check(struct list_head *l_copy)
+{
+    size_t n = 0;
+    element_t *item;
+    list_for_each_entry(item, l_copy, list)
+        n++;
+
+    dedup_ref_t *refs = malloc(n * sizeof(dedup_ref_t));
+    if (!refs) {
+        report(1,
+               "INTERNAL ERROR.  Could not allocate space for duplicate "
+               "checking");
+        return false;
+    }
+
+    // Match the new list against the old one, in order
+    struct list_head *l_tmp = current->q->next;
+    size_t i = 0;
+    list_for_each_entry(item, l_copy, list) {
+        refs[i].value = item->value;
+        refs[i].kept = l_tmp != current->q &&
+                       !strcmp(list_entry(l_tmp, element_t, list)->value,
+                               item->value);
+        if (refs[i].kept)
+            l_tmp = l_tmp->next;
+        else
+            current->size--;
+        i++;
+    }
+    bool ok = l_tmp == current->q;
+
+    // A string must be kept if and only if it occurred once
+    qsort(refs, n, sizeof(dedup_ref_t), dedup_ref_cmp);
+    for (i = 0; i < n;) {
+        size_t j = i + 1;
+        while (j < n && !strcmp(refs[i].value, refs[j].value))
+            j++;
+        bool once = j - i == 1;
+        for (; i < j; i++)
+            ok = ok && refs[i].kept == once;
+    }
+    free(refs);
+    return ok;
+}
+
 static bool do_dedup(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -508,7 +817,8 @@ static bool do_dedup(int argc, char *argv[])
 
     bool ok = true;
     if (exception_setup(true))
-        ok = q_delete_dup(current->q);
+        ok = dedup_hash ? q_delete_dup_hash(current->q)
+                        : q_delete_dup(current->q);
     exception_cancel();
 
     if (!ok) {
@@ -516,32 +826,49 @@ static bool do_dedup(int argc, char *argv[])
             free(item->value);
             free(item);
         }
-        report(1, "ERROR: Calling delete duplicate on null queue");
+        /* On a non-empty queue, only the hash set can have failed */
+        if (!dedup_hash || list_empty(current->q)) {
+            report(1, "ERROR: Calling delete duplicate on null queue");
+            return false;
+        }
+        fail_count++;
+        if (fail_count < fail_limit) {
+            report(2, "Allocation of the hash set for deletion failed");
+            return true;
+        }
+        report(1,
+               "ERROR: Allocation of the hash set for deletion failed (%d "
+               "failures total)",
+               fail_count);
         return false;
     }
 
-    struct list_head *l_tmp = current->q->next;
-    bool is_this_dup = false;
-    // Compare between new list and old one
-    list_for_each_entry(item, &l_copy, list) {
-        // Skip comparison with new list if the string is duplicate
-        bool is_next_dup =
-            item->list.next != &l_copy &&
-            strcmp(list_entry(item->list.next, element_t, list)->value,
-                   item->value) == 0;
-        if (is_this_dup || is_next_dup) {
-            // Update list size
-            current->size--;
-        } else if (l_tmp != current->q &&
-                   strcmp(list_entry(l_tmp, element_t, list)->value,
-                          item->value) == 0)
-            l_tmp = l_tmp->next;
-        else
-            ok = false;
-        is_this_dup = is_next_dup;
+    if (dedup_hash) {
+        ok = dedup_hash_check(&l_copy);
+    } else {
+        struct list_head *l_tmp = current->q->next;
+        bool is_this_dup = false;
+        // Compare between new list and old one
+        list_for_each_entry(item, &l_copy, list) {
+            // Skip comparison with new list if the string is duplicate
+            bool is_next_dup =
+                item->list.next != &l_copy &&
+                strcmp(list_entry(item->list.next, element_t, list)->value,
+                       item->value) == 0;
+            if (is_this_dup || is_next_dup) {
+                // Update list size
+                current->size--;
+            } else if (l_tmp != current->q &&
+                       strcmp(list_entry(l_tmp, element_t, list)->value,
+                              item->value) == 0)
+                l_tmp = l_tmp->next;
+            else
+                ok = false;
+            is_this_dup = is_next_dup;
+        }
+        // All elements in new list should be traversed
+        ok = ok && l_tmp == current->q;
     }
-    // All elements in new list should be traversed
-    ok = ok && l_tmp == current->q;
     if (!ok)
         report(1,
                "ERROR: Duplicate strings are in queue or distinct strings are "
@@ -620,6 +947,29 @@ static bool do_size(int argc, char *argv[])
     return ok && !error_check();
 }
 
+/* Position of a node in the queue before sorting, looked up by address */
+typedef struct {
+    struct list_head *node;
+    unsigned pos;
+} node_pos_t;
+
+static int cmp_node_pos(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t) ((const node_pos_t *) a)->node;
+    uintptr_t y = (uintptr_t) ((const node_pos_t *) b)->node;
+    return (x > y) - (x < y);
+}
+
+static unsigned node_pos(const node_pos_t *nodes,
+                         unsigned no,
+                         struct list_head *node)
+{
+    node_pos_t key = {.node = node};
+    const node_pos_t *found =
+        bsearch(&key, nodes, no, sizeof(node_pos_t), cmp_node_pos);
+    return found ? found->pos : 0;
+}
+
 bool do_sort(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -638,30 +988,49 @@ bool do_sort(int argc, char *argv[])
         report(3, "Warning: Calling sort on single node");
     error_check();
 
-    set_noallocate_mode(true);
+    /* q_sort_key may allocate its key array, but must release it */
+    size_t bcnt = allocation_check();
+    set_noallocate_mode(!sort_key);
 
 /* If the number of elements is too large, it may take a long time to check the
  * stability of the sort. So, MAX_NODES is used to limit the number of elements
  * to check the stability of the sort. */
 #define MAX_NODES 100000
-    struct list_head *nodes[MAX_NODES];
+    node_pos_t *nodes = NULL;
     unsigned no = 0;
     if (current && current->size && current->size <= MAX_NODES) {
+        nodes = malloc(sizeof(node_pos_t) * current->size);
         element_t *entry;
-        list_for_each_entry(entry, current->q, list)
-            nodes[no++] = &entry->list;
+        if (nodes) {
+            list_for_each_entry(entry, current->q, list) {
+                nodes[no].node = &entry->list;
+                nodes[no].pos = no;
+                no++;
+            }
+            qsort(nodes, no, sizeof(node_pos_t), cmp_node_pos);
+        }
     } else if (current && current->size > MAX_NODES)
         report(1,
                "Warning: Skip checking the stability of the sort because the "
                "number of elements %d is too large, exceeds the limit %d.",
                current->size, MAX_NODES);
 
-    if (current && exception_setup(true))
-        q_sort(current->q, descend);
+    if (current && exception_setup(true)) {
+        if (sort_threads > 1)
+            q_sort_parallel(current->q, descend, sort_threads);
+        else if (sort_key)
+            q_sort_key(current->q, descend);
+        else
+            q_sort(current->q, descend);
+    }
     exception_cancel();
     set_noallocate_mode(false);
 
     bool ok = true;
+    if (allocation_check() != bcnt) {
+        report(1, "ERROR: Sort did not release its temporary memory");
+        ok = false;
+    }
     if (current && current->size) {
         for (struct list_head *cur_l = current->q->next;
              cur_l != current->q && --cnt; cur_l = cur_l->next) {
@@ -681,18 +1050,9 @@ bool do_sort(int argc, char *argv[])
                 break;
             }
             /* Ensure the stability of the sort */
-            if (current->size <= MAX_NODES &&
-                !strcmp(item->value, next_item->value)) {
-                bool unstable = false;
-                for (unsigned i = 0; i < MAX_NODES; i++) {
-                    if (nodes[i] == cur_l->next) {
-                        unstable = true;
-                        break;
-                    }
-                    if (nodes[i] == cur_l) {
-                        break;
-                    }
-                }
+            if (nodes && !strcmp(item->value, next_item->value)) {
+                bool unstable = node_pos(nodes, no, cur_l->next) <
+                                node_pos(nodes, no, cur_l);
                 if (unstable) {
                     report(
                         1,
@@ -707,6 +1067,7 @@ bool do_sort(int argc, char *argv[])
     }
 #undef MAX_NODES
 
+    free(nodes);
     q_show(3);
     return ok && !error_check();
 }
@@ -886,7 +1247,31 @@ static bool do_reverseK(int argc, char *argv[])
     return !error_check();
 }
 
-static bool do_merge(int argc, char *argv[])
+/* Return the first element of queue not less than s, by a linear scan */
+static element_t *scan_lower_bound(struct list_head *q, const char *s)
+{
+    element_t *item;
+    list_for_each_entry(item, q, list) {
+        if (strcmp(item->value, s) >= 0)
+            return item;
+    }
+    return NULL;
+}
+
+static bool queue_is_ascending(struct list_head *q)
+{
+    if (list_empty(q))
+        return true;
+    for (struct list_head *cur_l = q->next; cur_l->next != q;
+         cur_l = cur_l->next) {
+        if (strcmp(list_entry(cur_l, element_t, list)->value,
+                   list_entry(cur_l->next, element_t, list)->value) > 0)
+            return false;
+    }
+    return true;
+}
+
+static bool do_index(int argc, char *argv[])
 {
     if (argc != 1) {
         report(1, "%s takes no arguments", argv[0]);
@@ -894,80 +1279,455 @@ static bool do_merge(int argc, char *argv[])
     }
 
     if (!current || !current->q) {
-        report(3, "Warning: Calling merge on null queue");
+        report(3, "Warning: Calling index on null queue");
         return false;
     }
     error_check();
 
-    int len = 0;
-    set_noallocate_mode(true);
-    if (current && exception_setup(true))
-        len = q_merge(&chain.head, descend);
-    exception_cancel();
-    set_noallocate_mode(false);
+    if (!queue_is_ascending(current->q))
+        report(1, "Warning: Queue is not sorted in ascending order");
 
-    if (q_size(&chain.head) > 1) {
-        chain.size = 1;
-        current = list_entry(chain.head.next, queue_contex_t, chain);
-        current->size = len;
+    bool ok = false;
+    if (exception_setup(true))
+        ok = q_index_build(current->q);
+    exception_cancel();
 
-        struct list_head *cur = chain.head.next->next;
-        while ((uintptr_t) cur != (uintptr_t) &chain.head) {
-            queue_contex_t *ctx = list_entry(cur, queue_contex_t, chain);
-            cur = cur->next;
-            q_free(ctx->q);
-            free(ctx);
-        }
+    if (!ok)
+        report(1, "ERROR: Could not build index");
+    return ok && !error_check();
+}
 
-        chain.head.prev = &current->chain;
-        current->chain.next = &chain.head;
+static bool do_find(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
     }
 
-    bool ok = true;
-    if (current && current->size) {
-        for (struct list_head *cur_l = current->q->next;
-             cur_l != current->q && --len; cur_l = cur_l->next) {
-            /* Ensure each element in ascending order */
-            element_t *item, *next_item;
-            item = list_entry(cur_l, element_t, list);
-            next_item = list_entry(cur_l->next, element_t, list);
-            if (!descend && strcmp(item->value, next_item->value) > 0) {
-                report(1,
-                       "ERROR: Not sorted in ascending order (It might because "
-                       "of unsorted queues are merged or there're some flaws "
-                       "in 'q_merge')");
-                ok = false;
-                break;
-            }
+    if (!current || !current->q) {
+        report(3, "Warning: Calling find on null queue");
+        return false;
+    }
+    error_check();
 
+    /* The index may be laid out again, which allocates */
+    element_t *lb = NULL, *found = NULL;
+    if (exception_setup(true)) {
+        lb = q_index_lower_bound(current->q, argv[1]);
+        found = q_index_find(current->q, argv[1]);
+    }
+    exception_cancel();
 
-            if (descend && strcmp(item->value, next_item->value) < 0) {
-                report(
-                    1,
-                    "ERROR: Not sorted in descending order (It might because "
-                    "of unsorted queues are merged or there're some flaws "
-                    "in 'q_merge')");
-                ok = false;
-                break;
-            }
-        }
+    bool ok = true;
+    element_t *expected = scan_lower_bound(current->q, argv[1]);
+    if (lb != expected) {
+        report(1, "ERROR: Lower bound of %s is not the right element",
+               argv[1]);
+        ok = false;
+    } else if (found != (lb && !strcmp(lb->value, argv[1]) ? lb : NULL)) {
+        report(1, "ERROR: Finding %s returned the wrong element", argv[1]);
+        ok = false;
+    } else if (found) {
+        report(2, "Found %s", argv[1]);
+    } else if (lb) {
+        report(2, "%s not found, next is %s", argv[1], lb->value);
+    } else {
+        report(2, "%s not found, no greater string", argv[1]);
     }
 
-    q_show(3);
     return ok && !error_check();
 }
 
-static bool is_circular()
+static bool do_ins(int argc, char *argv[])
 {
-    struct list_head *cur = current->q->next;
-    struct list_head *fast = (cur) ? cur->next : NULL;
-    while (cur != current->q) {
-        if (!cur || !fast || !fast->next)
-            return false;
-        if (cur == fast)
-            return false;
-        cur = cur->next;
-        fast = fast->next->next;
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling ins on null queue");
+        return false;
+    }
+    error_check();
+
+    bool ok = true, inserted = false;
+    if (exception_setup(true))
+        inserted = q_index_insert(current->q, argv[1]);
+    exception_cancel();
+
+    if (!inserted) {
+        fail_count++;
+        if (fail_count < fail_limit)
+            report(2, "Insertion of %s failed", argv[1]);
+        else {
+            report(1, "ERROR: Insertion of %s failed (%d failures total)",
+                   argv[1], fail_count);
+            ok = false;
+        }
+    } else {
+        current->size++;
+        if (!queue_is_ascending(current->q)) {
+            report(1, "ERROR: Queue is not sorted after inserting %s",
+                   argv[1]);
+            ok = false;
+        }
+    }
+
+    q_show(3);
+    return ok && !error_check();
+}
+
+static bool do_del(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling del on null queue");
+        return false;
+    }
+    error_check();
+
+    element_t *expected = scan_lower_bound(current->q, argv[1]);
+    bool present = expected && !strcmp(expected->value, argv[1]);
+
+    bool ok = false;
+    if (exception_setup(true))
+        ok = q_index_delete(current->q, argv[1]);
+    exception_cancel();
+
+    if (ok != present) {
+        report(1, "ERROR: Deleting %s returned %s", argv[1],
+               ok ? "true" : "false");
+        ok = false;
+    } else if (!ok) {
+        report(2, "%s not in queue", argv[1]);
+        ok = true;
+    } else {
+        current->size--;
+    }
+
+    q_show(3);
+    return ok && !error_check();
+}
+
+static void heap_show(int vlevel)
+{
+    element_t *top = pq_peek(heap);
+    if (top)
+        report(vlevel, "Heap size = %d, least = %s", pq_size(heap),
+               top->value);
+    else
+        report(vlevel, "Heap is empty");
+}
+
+static void heap_trim(void)
+{
+    if (heap && !pq_size(heap)) {
+        pq_free(heap);
+        heap = NULL;
+    }
+}
+
+static bool do_pq_push(int argc, char *argv[])
+{
+    int reps = 1;
+    if (argc != 2 && argc != 3) {
+        report(1, "%s needs 1-2 arguments", argv[0]);
+        return false;
+    }
+    if (argc == 3 && (!get_int(argv[2], &reps) || reps < 1)) {
+        report(1, "Invalid number of insertions '%s'", argv[2]);
+        return false;
+    }
+
+    char randstr_buf[MAX_RANDSTR_LEN];
+    bool need_rand = !strcmp(argv[1], "RAND");
+    char *inserts = need_rand ? randstr_buf : argv[1];
+    error_check();
+
+    /* Elements are made in a scratch queue, then handed over to the heap */
+    if (!heap)
+        heap = pq_new();
+    struct list_head *scratch = q_new();
+    if (!heap || !scratch) {
+        report(1, "ERROR: Could not set up heap");
+        q_free(scratch);
+        return false;
+    }
+
+    bool ok = true;
+    if (exception_setup(true)) {
+        for (int r = 0; ok && r < reps; r++) {
+            if (need_rand &&
+                !(ok = fill_rand_string(randstr_buf, sizeof(randstr_buf))))
+                break;
+            if (q_insert_tail(scratch, inserts))
+                continue;
+            fail_count++;
+            if (fail_count < fail_limit)
+                report(2, "Insertion of %s failed", inserts);
+            else {
+                report(1, "ERROR: Insertion of %s failed (%d failures total)",
+                       inserts, fail_count);
+                ok = false;
+            }
+        }
+
+        int before = pq_size(heap), pushed = q_size(scratch);
+        pq_push_queue(heap, scratch);
+        if (pq_size(heap) != before + pushed) {
+            report(1, "ERROR: Heap size is %d after pushing %d elements to %d",
+                   pq_size(heap), pushed, before);
+            ok = false;
+        }
+    }
+    exception_cancel();
+
+    q_free(scratch);
+    heap_trim();
+    heap_show(3);
+    return ok && !error_check();
+}
+
+static bool do_pq_pop(int argc, char *argv[])
+{
+    int reps = 1;
+    if (argc > 2) {
+        report(1, "%s takes at most one argument", argv[0]);
+        return false;
+    }
+    if (argc == 2 && (!get_int(argv[1], &reps) || reps < 1)) {
+        report(1, "Invalid number of removals '%s'", argv[1]);
+        return false;
+    }
+    if (pq_size(heap) < reps) {
+        report(1, "ERROR: Cannot pop %d elements from a heap of %d", reps,
+               pq_size(heap));
+        return false;
+    }
+    error_check();
+
+    /* Each popped element must be the one peeked at before, and hold no less
+     * than the previous one.
+     */
+    int mispeeked = 0, misordered = 0;
+    element_t *prev = NULL;
+    if (exception_setup(true)) {
+        for (int r = 0; r < reps; r++) {
+            element_t *top = pq_peek(heap);
+            element_t *e = pq_pop_min(heap);
+            if (!e)
+                break;
+            mispeeked += e != top;
+            if (prev) {
+                misordered += strcmp(prev->value, e->value) > 0;
+                q_release_element(prev);
+            }
+            prev = e;
+        }
+    }
+    exception_cancel();
+
+    bool ok = true;
+    if (!prev) {
+        report(1, "ERROR: Popping from heap failed");
+        ok = false;
+    } else if (reps == 1) {
+        report(2, "Removed %s from heap", prev->value);
+    }
+    if (mispeeked) {
+        report(1, "ERROR: %d popped elements were not the ones peeked at",
+               mispeeked);
+        ok = false;
+    }
+    if (misordered) {
+        report(1, "ERROR: %d popped elements were less than the one before",
+               misordered);
+        ok = false;
+    }
+    if (prev)
+        q_release_element(prev);
+
+    heap_trim();
+    heap_show(3);
+    return ok && !error_check();
+}
+
+static bool do_pq_peek(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    heap_show(1);
+    return !error_check();
+}
+
+static bool do_pq_meld(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling pq_meld on null queue");
+        return false;
+    }
+    error_check();
+
+    if (!heap)
+        heap = pq_new();
+    pqueue_t *other = pq_new();
+    if (!heap || !other) {
+        report(1, "ERROR: Could not set up heap");
+        pq_free(other);
+        return false;
+    }
+
+    bool ok = false;
+    int before = pq_size(heap);
+    if (exception_setup(true)) {
+        ok = pq_push_queue(other, current->q);
+        if (ok)
+            pq_meld(heap, other);
+    }
+    exception_cancel();
+    pq_free(other);
+
+    if (!ok) {
+        report(1, "ERROR: Elements of an arena-backed queue cannot move");
+    } else if (pq_size(heap) != before + current->size) {
+        report(1, "ERROR: Heap size is %d after melding %d elements into %d",
+               pq_size(heap), current->size, before);
+        ok = false;
+    }
+    if (ok)
+        current->size = 0;
+
+    heap_trim();
+    q_show(3);
+    heap_show(3);
+    return ok && !error_check();
+}
+
+static bool do_rotate(int argc, char *argv[])
+{
+    int k = 0;
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling rotate on null queue");
+        return false;
+    }
+    error_check();
+
+    if (argc != 2) {
+        report(1, "Invalid number of arguments for rotate");
+        return false;
+    }
+    if (!get_int(argv[1], &k)) {
+        report(1, "Invalid number of K");
+        return false;
+    }
+
+    set_noallocate_mode(true);
+    if (exception_setup(true))
+        q_rotate(current->q, k);
+    exception_cancel();
+
+    set_noallocate_mode(false);
+    q_show(3);
+    return !error_check();
+}
+
+static bool do_merge(int argc, char *argv[])
+{
+    if (argc != 1) {
+        report(1, "%s takes no arguments", argv[0]);
+        return false;
+    }
+
+    if (!current || !current->q) {
+        report(3, "Warning: Calling merge on null queue");
+        return false;
+    }
+    error_check();
+
+    int len = 0;
+    set_noallocate_mode(true);
+    if (current && exception_setup(true))
+        len = merge_pairwise ? q_merge_pairwise(&chain.head, descend)
+                             : q_merge(&chain.head, descend);
+    exception_cancel();
+    set_noallocate_mode(false);
+
+    if (chain.size > 1) {
+        chain.size = 1;
+        current = list_entry(chain.head.next, queue_contex_t, chain);
+        current->size = len;
+
+        struct list_head *cur = chain.head.next->next;
+        while ((uintptr_t) cur != (uintptr_t) &chain.head) {
+            queue_contex_t *ctx = list_entry(cur, queue_contex_t, chain);
+            cur = cur->next;
+            q_free(ctx->q);
+            free(ctx);
+        }
+
+        chain.head.prev = &current->chain;
+        current->chain.next = &chain.head;
+    }
+
+    bool ok = true;
+    if (current && current->size) {
+        for (struct list_head *cur_l = current->q->next;
+             cur_l != current->q && --len; cur_l = cur_l->next) {
+            /* Ensure each element in ascending order */
+            element_t *item, *next_item;
+            item = list_entry(cur_l, element_t, list);
+            next_item = list_entry(cur_l->next, element_t, list);
+            if (!descend && strcmp(item->value, next_item->value) > 0) {
+                report(1,
+                       "ERROR: Not sorted in ascending order (It might because "
+                       "of unsorted queues are merged or there're some flaws "
+                       "in 'q_merge')");
+                ok = false;
+                break;
+            }
+
+
+            if (descend && strcmp(item->value, next_item->value) < 0) {
+                report(
+                    1,
+                    "ERROR: Not sorted in descending order (It might because "
+                    "of unsorted queues are merged or there're some flaws "
+                    "in 'q_merge')");
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    q_show(3);
+    return ok && !error_check();
+}
+
+static bool is_circular()
+{
+    struct list_head *cur = current->q->next;
+    struct list_head *fast = (cur) ? cur->next : NULL;
+    while (cur != current->q) {
+        if (!cur || !fast || !fast->next)
+            return false;
+        if (cur == fast)
+            return false;
+        cur = cur->next;
+        fast = fast->next->next;
     }
 
     cur = current->q->prev;
@@ -1041,6 +1801,530 @@ static bool q_show(int vlevel)
     return ok;
 }
 
+/* Run an operation of a compiled trace that stands for a queue command, with
+ * the checks of that command but none of its reports.
+ */
+static bool replay_op(const btrace_op_t *op)
+{
+    struct list_head *q = current ? current->q : NULL;
+    switch (op->code) {
+    case BT_IH:
+    case BT_IT: {
+        /* Inserting into a null queue is not a failure, as for ih and it */
+        if (!q)
+            return true;
+        char randstr_buf[MAX_RANDSTR_LEN];
+        for (uint32_t r = 0; r < op->n; r++) {
+            char *s = op->str;
+            if (!s) {
+                if (!fill_rand_string(randstr_buf, sizeof(randstr_buf)))
+                    return false;
+                s = randstr_buf;
+            }
+            bool inserted = op->code == BT_IT ? q_insert_tail(q, s)
+                                              : q_insert_head(q, s);
+            if (inserted) {
+                current->size++;
+            } else if (++fail_count >= fail_limit) {
+                report(1, "ERROR: Insertion of %s failed (%d failures total)",
+                       s, fail_count);
+                return false;
+            }
+        }
+        return true;
+    }
+    case BT_RH:
+    case BT_RT: {
+        /* Longer strings are cut at MAXSTRING instead of at string_length */
+        char removes[MAXSTRING + 1];
+        int len = string_length < MAXSTRING ? string_length : MAXSTRING;
+        /* As for rh and rt, a null queue only counts as one failure */
+        element_t *re = NULL;
+        if (q)
+            re = op->code == BT_RT ? q_remove_tail(q, removes, len + 1)
+                                   : q_remove_head(q, removes, len + 1);
+        if (!re) {
+            if (++fail_count < fail_limit && !op->str)
+                return true;
+            report(1, "ERROR: Removal from queue failed (%d failures total)",
+                   fail_count);
+            return false;
+        }
+        q_release_element(re);
+        current->size--;
+        if (op->str && strncmp(removes, op->str, len)) {
+            report(1, "ERROR: Removed value %s != expected value %s", removes,
+                   op->str);
+            return false;
+        }
+        return true;
+    }
+    case BT_SIZE:
+        if (q && q_size(q) != current->size) {
+            report(1,
+                   "ERROR: Computed queue size as %d, but correct value is %d",
+                   q_size(q), current->size);
+            return false;
+        }
+        return true;
+    default:
+        break;
+    }
+
+    /* The remaining commands fail on a null queue, except reverse */
+    if (!q)
+        return op->code == BT_REVERSE;
+    bool ok = true;
+    set_noallocate_mode(op->code != BT_DM);
+    switch (op->code) {
+    case BT_REVERSE:
+        q_reverse(q);
+        break;
+    case BT_SWAP:
+        q_swap(q);
+        break;
+    case BT_REVERSEK:
+        q_reverseK(q, op->n);
+        break;
+    case BT_DM:
+        ok = q_delete_mid(q);
+        if (current->size)
+            current->size--;
+        break;
+    default:
+        ok = false;
+    }
+    set_noallocate_mode(false);
+    return ok;
+}
+
+static bool do_replay(int argc, char *argv[])
+{
+    if (argc != 2) {
+        report(1, "%s needs 1 argument", argv[0]);
+        return false;
+    }
+
+    btrace_t *bt = btrace_open(argv[1]);
+    if (!bt) {
+        report(1, "ERROR: Could not load compiled trace '%s'", argv[1]);
+        return false;
+    }
+    error_check();
+
+    /* Runs of queue operations share one exception handler, whose time limit
+     * restarts for every operation as it would for the command. Restarting
+     * costs a system call, so it waits until a millisecond has passed, which
+     * makes no difference to a limit counted in seconds. Sorts go through the
+     * sort command, for the same checks, and other commands through the
+     * console. Both set up their own handler.
+     */
+    char *sort_argv[] = {"sort", NULL};
+    struct timespec armed_at, now;
+    btrace_op_t op;
+    volatile bool armed = false;
+    bool ok = true;
+    int r;
+    while ((r = btrace_next(bt, &op)) > 0) {
+        if (op.code == BT_CMD || op.code == BT_SORT) {
+            if (armed)
+                exception_cancel();
+            armed = false;
+            if (op.code == BT_SORT) {
+                if (error_check() || !do_sort(1, sort_argv)) {
+                    ok = false;
+                    break;
+                }
+                continue;
+            }
+            /* Failed commands are counted by the console already */
+            interpret_cmda(op.argc, op.argv);
+            if (quit_requested())
+                break;
+            continue;
+        }
+
+        if (!armed) {
+            if (!exception_setup(true)) {
+                set_noallocate_mode(false);
+                ok = false;
+                break;
+            }
+            armed = true;
+            clock_gettime(CLOCK_MONOTONIC, &armed_at);
+        } else {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if ((now.tv_sec - armed_at.tv_sec) * 1000000000L + now.tv_nsec -
+                    armed_at.tv_nsec >
+                1000000L) {
+                exception_rearm();
+                armed_at = now;
+            }
+        }
+        if (!replay_op(&op)) {
+            ok = false;
+            break;
+        }
+    }
+    if (armed)
+        exception_cancel();
+
+    /* The arguments are gone if the trace quit */
+    if (ok && r < 0) {
+        report(1, "ERROR: Operation %" PRIu64 " of the trace is malformed",
+               btrace_pos(bt) + 1);
+        ok = false;
+    } else if (!ok) {
+        report(1, "ERROR: Replay stopped at operation %" PRIu64,
+               btrace_pos(bt));
+    }
+    btrace_close(bt);
+
+    if (!quit_requested())
+        q_show(3);
+    return ok && !error_check();
+}
+
+/* Threads started by the mpmc command are capped */
+#define MPMC_MAX_THREADS 64
+
+typedef struct {
+    cqueue_t *cq;
+    element_t **elems; /* Element i holds the string of i */
+    int count;
+    int nprod;
+    int id;
+    atomic_int *producing; /* Producers not done pushing yet */
+    atomic_uint *seen;     /* Times element i was popped */
+    int corrupted;         /* Popped elements with a mangled string */
+    int reordered;         /* Popped out of the order a producer pushed */
+} mpmc_worker_t;
+
+/* Producer id pushes elements id, id + nprod, id + 2 * nprod, ... */
+static void *mpmc_produce(void *arg)
+{
+    mpmc_worker_t *w = arg;
+    for (int i = w->id; i < w->count; i += w->nprod) {
+        while (!cq_push(w->cq, w->elems[i]))
+            sched_yield();
+    }
+    atomic_fetch_sub(w->producing, 1);
+    return NULL;
+}
+
+static void *mpmc_consume(void *arg)
+{
+    mpmc_worker_t *w = arg;
+    int last[MPMC_MAX_THREADS];
+    for (int p = 0; p < w->nprod; p++)
+        last[p] = -1;
+
+    for (;;) {
+        /* Once every producer is done, an empty queue stays empty */
+        bool done = !atomic_load(w->producing);
+        element_t *e = cq_pop(w->cq);
+        if (!e) {
+            if (done)
+                break;
+            sched_yield();
+            continue;
+        }
+
+        char *end;
+        long i = strtol(e->value, &end, 10);
+        if (*end || end == e->value || i < 0 || i >= w->count) {
+            w->corrupted++;
+            continue;
+        }
+        atomic_fetch_add(&w->seen[i], 1);
+        if (i <= last[i % w->nprod])
+            w->reordered++;
+        last[i % w->nprod] = i;
+    }
+    return NULL;
+}
+
+static bool do_mpmc(int argc, char *argv[])
+{
+    int nprod = 4, ncons = 4, count = 100000, capacity = 1024;
+
+    if (argc > 5) {
+        report(1, "%s takes at most four arguments", argv[0]);
+        return false;
+    }
+    if ((argc > 1 && !get_int(argv[1], &nprod)) ||
+        (argc > 2 && !get_int(argv[2], &ncons)) ||
+        (argc > 3 && !get_int(argv[3], &count)) ||
+        (argc > 4 && !get_int(argv[4], &capacity))) {
+        report(1, "Invalid argument for %s", argv[0]);
+        return false;
+    }
+    if (nprod < 1 || ncons < 1 || nprod + ncons > MPMC_MAX_THREADS ||
+        count < 0 || capacity < 1) {
+        report(1, "Need 1 to %d threads in total, and a positive capacity",
+               MPMC_MAX_THREADS);
+        return false;
+    }
+    error_check();
+
+    /* Elements are prepared here: the harness allocator is not thread-safe,
+     * and the workers only ever pass pointers around.
+     */
+    struct list_head *pool = q_new();
+    element_t **elems = malloc(sizeof(element_t *) * (count ? count : 1));
+    atomic_uint *seen = calloc(count ? count : 1, sizeof(atomic_uint));
+    cqueue_t *cq = cq_new(capacity);
+    bool ok = pool && elems && seen && cq;
+    for (int i = 0; ok && i < count; i++) {
+        char buf[16];
+        snprintf(buf, sizeof(buf), "%d", i);
+        ok = q_insert_tail(pool, buf);
+    }
+    if (!ok) {
+        report(1, "ERROR: Could not set up %d elements", count);
+        goto out;
+    }
+    struct list_head *node = pool->next;
+    for (int i = 0; i < count; i++, node = node->next)
+        elems[i] = list_entry(node, element_t, list);
+
+    atomic_int producing;
+    atomic_init(&producing, nprod);
+    mpmc_worker_t workers[MPMC_MAX_THREADS];
+    pthread_t tid[MPMC_MAX_THREADS];
+    bool spawned[MPMC_MAX_THREADS] = {false};
+    for (int t = 0; t < nprod + ncons; t++) {
+        workers[t] = (mpmc_worker_t){
+            .cq = cq,
+            .elems = elems,
+            .count = count,
+            .nprod = nprod,
+            .id = t < nprod ? t : t - nprod,
+            .producing = &producing,
+            .seen = seen,
+        };
+    }
+
+    /* Workers inherit a mask that keeps SIGALRM on the calling thread */
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+
+    /* Consumers go first, so that producers can never wait on a full ring
+     * with nobody left to drain it.
+     */
+    int started = 0;
+    for (int t = nprod; t < nprod + ncons; t++) {
+        spawned[t] = !pthread_create(&tid[t], NULL, mpmc_consume, &workers[t]);
+        started += spawned[t];
+    }
+    if (started) {
+        for (int t = 0; t < nprod; t++)
+            spawned[t] =
+                !pthread_create(&tid[t], NULL, mpmc_produce, &workers[t]);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (!started) {
+        report(1, "ERROR: Could not start any consumer thread");
+        ok = false;
+        goto out;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int t = 0; t < nprod; t++) {
+        if (spawned[t])
+            pthread_join(tid[t], NULL);
+        else
+            mpmc_produce(&workers[t]);
+    }
+    for (int t = nprod; t < nprod + ncons; t++) {
+        if (spawned[t])
+            pthread_join(tid[t], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    int lost = 0, duplicated = 0, corrupted = 0, reordered = 0;
+    for (int i = 0; i < count; i++) {
+        unsigned int n = atomic_load(&seen[i]);
+        lost += !n;
+        duplicated += n > 1;
+    }
+    for (int t = nprod; t < nprod + ncons; t++) {
+        corrupted += workers[t].corrupted;
+        reordered += workers[t].reordered;
+    }
+
+    if (lost)
+        report(1, "ERROR: %d elements were never popped", lost);
+    if (duplicated)
+        report(1, "ERROR: %d elements were popped more than once", duplicated);
+    if (corrupted)
+        report(1, "ERROR: %d popped elements were corrupted", corrupted);
+    if (reordered)
+        report(1, "ERROR: %d elements overtook one from the same producer",
+               reordered);
+    ok = !lost && !duplicated && !corrupted && !reordered;
+    if (ok)
+        report(3, "%d elements passed through %d producers and %d consumers "
+                  "in %.3f s",
+               count, nprod, ncons,
+               (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+
+out:
+    cq_free(cq);
+    free(seen);
+    free(elems);
+    q_free(pool);
+    return ok && !error_check();
+}
+
+/* Largest batch the ring command moves at once */
+#define RING_MAX_BATCH 1024
+
+/* Strings are the decimal sequence numbers, sized for any int */
+#define RING_STR_LEN 12
+
+typedef struct {
+    ring_t *ring;
+    int count; /* Strings to remove before returning */
+    int next;  /* Sequence number of the next string to remove */
+    int batch;
+    char *bufs;     /* batch buffers of RING_STR_LEN bytes */
+    int mismatched; /* Strings other than the next expected one */
+} ring_worker_t;
+
+static void *ring_consume(void *arg)
+{
+    ring_worker_t *w = arg;
+    char *sp[RING_MAX_BATCH];
+    for (int k = 0; k < w->batch; k++)
+        sp[k] = w->bufs + k * RING_STR_LEN;
+
+    while (w->next < w->count) {
+        size_t n = ring_remove_head_batch(w->ring, sp, w->batch, RING_STR_LEN);
+        if (!n) {
+            sched_yield();
+            continue;
+        }
+        for (size_t k = 0; k < n; k++, w->next++) {
+            char *end;
+            if (strtol(sp[k], &end, 10) != w->next || *end)
+                w->mismatched++;
+        }
+    }
+    return NULL;
+}
+
+static bool do_ring(int argc, char *argv[])
+{
+    if (simulation) {
+        if (argc != 1) {
+            report(1, "%s does not need arguments in simulation mode", argv[0]);
+            return false;
+        }
+        bool ok = is_ring_insert_tail_const() && is_ring_remove_head_const();
+        if (!ok) {
+            report(1,
+                   "ERROR: Probably not constant time or wrong implementation");
+            return false;
+        }
+        report(1, "Probably constant time");
+        return ok;
+    }
+
+    int count = 100000, batch = 32, capacity = 1024;
+    if (argc > 4) {
+        report(1, "%s takes at most three arguments", argv[0]);
+        return false;
+    }
+    if ((argc > 1 && !get_int(argv[1], &count)) ||
+        (argc > 2 && !get_int(argv[2], &batch)) ||
+        (argc > 3 && !get_int(argv[3], &capacity))) {
+        report(1, "Invalid argument for %s", argv[0]);
+        return false;
+    }
+    if (count < 0 || batch < 1 || batch > RING_MAX_BATCH || capacity < 1) {
+        report(1, "Need a batch of 1 to %d strings, and a positive capacity",
+               RING_MAX_BATCH);
+        return false;
+    }
+    error_check();
+
+    ring_t *ring = ring_new(capacity);
+    char *pbufs = malloc(RING_STR_LEN * batch);
+    char *cbufs = malloc(RING_STR_LEN * batch);
+    if (!ring || !pbufs || !cbufs) {
+        report(1, "ERROR: Could not allocate a ring of %d strings", capacity);
+        ring_free(ring);
+        free(pbufs);
+        free(cbufs);
+        return false;
+    }
+
+    ring_worker_t consumer = {
+        .ring = ring,
+        .count = count,
+        .batch = batch,
+        .bufs = cbufs,
+    };
+
+    /* The consumer inherits a mask that keeps SIGALRM on this thread */
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    pthread_t tid;
+    bool spawned = !pthread_create(&tid, NULL, ring_consume, &consumer);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    /* Without a consumer thread, drain the ring after every insertion */
+    if (!spawned)
+        consumer.count = 0;
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    char *s[RING_MAX_BATCH];
+    for (int k = 0; k < batch; k++)
+        s[k] = pbufs + k * RING_STR_LEN;
+    for (int next = 0; next < count;) {
+        int n = count - next < batch ? count - next : batch;
+        for (int k = 0; k < n; k++)
+            snprintf(s[k], RING_STR_LEN, "%d", next + k);
+        for (int k = 0; k < n;) {
+            size_t done = ring_insert_tail_batch(ring, s + k, n - k);
+            k += done;
+            if (!spawned) {
+                consumer.count = next + k;
+                ring_consume(&consumer);
+            } else if (!done) {
+                sched_yield();
+            }
+        }
+        next += n;
+    }
+    if (spawned)
+        pthread_join(tid, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    bool ok = !consumer.mismatched && !ring_size(ring);
+    if (consumer.mismatched)
+        report(1, "ERROR: %d strings came out of order or mangled",
+               consumer.mismatched);
+    if (ring_size(ring))
+        report(1, "ERROR: %zu strings were left in the ring", ring_size(ring));
+    if (ok)
+        report(3, "%d strings passed through the ring in %.3f s", count,
+               (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9);
+
+    ring_free(ring);
+    free(pbufs);
+    free(cbufs);
+    return ok && !error_check();
+}
+
 static bool do_show(int argc, char *argv[])
 {
     if (argc != 1) {
@@ -1114,6 +2398,10 @@ static void console_init()
                 "Insert string str at tail of queue n times. Generate random "
                 "string(s) if str equals RAND. (default: n == 1)",
                 "str [n]");
+    ADD_COMMAND(gen,
+                "Insert n keys at tail of queue, drawn from distribution dist "
+                "(random, sorted, reverse, nearly, dup, zipf or prefix)",
+                "dist n [seed]");
     ADD_COMMAND(
         rh,
         "Remove from head of queue. Optionally compare to expected value str",
@@ -1122,6 +2410,9 @@ static void console_init()
         rt,
         "Remove from tail of queue. Optionally compare to expected value str",
         "[str]");
+    ADD_COMMAND(rhn,
+                "Remove n elements from head of queue at once and release them",
+                "n");
     ADD_COMMAND(reverse, "Reverse queue", "");
     ADD_COMMAND(sort, "Sort queue in ascending/descending order", "");
     ADD_COMMAND(size, "Compute queue size n times (default: n == 1)", "[n]");
@@ -1140,7 +2431,34 @@ static void console_init()
                 "");
     ADD_COMMAND(reverseK, "Reverse the nodes of the queue 'K' at a time",
                 "[K]");
+    ADD_COMMAND(rotate,
+                "Move 'K' nodes from head to tail of queue (tail to head if "
+                "negative)",
+                "[K]");
     ADD_COMMAND(shuffle, "Shuffle the queue", "");
+    ADD_COMMAND(index, "Build a skip-list index over the sorted queue", "");
+    ADD_COMMAND(find, "Look up a string in the sorted queue", "str");
+    ADD_COMMAND(ins, "Insert a string in order in the sorted queue", "str");
+    ADD_COMMAND(del, "Delete the first node holding a string", "str");
+    ADD_COMMAND(pq_push,
+                "Push str onto the heap n times. Generate random string(s) if "
+                "str equals RAND. (default: n == 1)",
+                "str [n]");
+    ADD_COMMAND(pq_pop,
+                "Pop the least string from the heap n times (default: n == 1)",
+                "[n]");
+    ADD_COMMAND(pq_peek, "Show the least string in the heap", "");
+    ADD_COMMAND(pq_meld, "Move all nodes of the queue into the heap", "");
+    ADD_COMMAND(replay,
+                "Replay a trace compiled by scripts/compile-trace.py", "file");
+    ADD_COMMAND(mpmc,
+                "Pass N elements from P producer to C consumer threads through "
+                "a lock-free queue of the given capacity",
+                "[P] [C] [N] [capacity]");
+    ADD_COMMAND(ring,
+                "Pass N strings from a producer to a consumer thread through "
+                "a ring, in batches",
+                "[N] [batch] [capacity]");
     add_param("length", &string_length, "Maximum length of displayed string",
               NULL);
     add_param("malloc", &fail_probability, "Malloc failure probability percent",
@@ -1149,6 +2467,20 @@ static void console_init()
               "Number of times allow queue operations to return false", NULL);
     add_param("descend", &descend,
               "Sort and merge queue in ascending/descending order", NULL);
+    add_param("sort_key", &sort_key,
+              "Sort through an array of key prefixes (q_sort_key)", NULL);
+    add_param("sort_threads", &sort_threads,
+              "Number of threads used to sort (q_sort_parallel)", NULL);
+    add_param("merge_pairwise", &merge_pairwise,
+              "Merge queues pairwise in rounds (q_merge_pairwise)", NULL);
+    add_param("shuffle_merge", &shuffle_merge,
+              "Shuffle without extra memory (q_shuffle_merge)", NULL);
+    add_param("arena", &arena,
+              "Allocate elements of new queues from an arena (q_new_arena)",
+              NULL);
+    add_param("dedup_hash", &dedup_hash,
+              "Delete duplicates of an unsorted queue (q_delete_dup_hash)",
+              NULL);
     add_param("rand_method", &prng, "Pseudo random number generator selector",
               NULL);
 }
@@ -1183,8 +2515,6 @@ static void q_init()
 static bool q_quit(int argc, char *argv[])
 {
     report(3, "Freeing queue");
-    if (current && current->size > BIG_LIST_SIZE)
-        set_cautious_mode(false);
 
     if (exception_setup(true)) {
         struct list_head *cur = chain.head.next;
@@ -1195,10 +2525,11 @@ static bool q_quit(int argc, char *argv[])
             free(qctx);
             chain.size--;
         }
+        pq_free(heap);
+        heap = NULL;
     }
 
     exception_cancel();
-    set_cautious_mode(true);
 
     size_t bcnt = allocation_check();
     if (bcnt > 0) {
@@ -1212,11 +2543,12 @@ static bool q_quit(int argc, char *argv[])
 
 static void usage(char *cmd)
 {
-    printf("Usage: %s [-h] [-f FILE][-v LEVEL][-l LOG\n", cmd);
+    printf("Usage: %s [-h] [-f FILE][-v LEVEL][-l LOG][-t TIMES]\n", cmd);
     printf("\t-h         Print this information\n");
     printf("\t-f FILE   Read commands from FILE\n");
     printf("\t-v LEVEL  Set verbosity level\n");
     printf("\t-l LOG    Echo results to LOG\n");
+    printf("\t-t TIMES  Record the run time of each command to TIMES\n");
     exit(0);
 }
 
@@ -1423,10 +2755,12 @@ int main(int argc, char *argv[])
     char *infile_name = NULL;
     char lbuf[BUFSIZE];
     char *logfile_name = NULL;
+    char tbuf[BUFSIZE];
+    char *timefile_name = NULL;
     int level = 4;
     int c;
 
-    while ((c = getopt(argc, argv, "hv:f:l:")) != -1) {
+    while ((c = getopt(argc, argv, "hv:f:l:t:")) != -1) {
         switch (c) {
         case 'h':
             usage(argv[0]);
@@ -1451,6 +2785,11 @@ int main(int argc, char *argv[])
             buf[BUFSIZE - 1] = '\0';
             logfile_name = lbuf;
             break;
+        case 't':
+            strncpy(tbuf, optarg, BUFSIZE);
+            tbuf[BUFSIZE - 1] = '\0';
+            timefile_name = tbuf;
+            break;
         default:
             printf("Unknown option '%c'\n", c);
             usage(argv[0]);
@@ -1481,6 +2820,10 @@ int main(int argc, char *argv[])
         set_echo(true);
     if (logfile_name)
         set_logfile(logfile_name);
+    if (timefile_name && !set_timefile(timefile_name)) {
+        fprintf(stderr, "Couldn't open time file '%s'\n", timefile_name);
+        exit(EXIT_FAILURE);
+    }
 
     add_quit_helper(q_quit);
 
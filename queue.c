@@ -1,3 +1,6 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,16 +19,101 @@ static int q_merge_two(struct list_head *ll1,
                        struct list_head *ll2,
                        bool descend);
 
+/* Towers get level L with probability 3/4 * (1/4)^L, up to the limit */
+#define Q_INDEX_MAX_LEVEL 16
+
+/* Links of a node above the bottom level of the skip list */
+typedef struct q_tower {
+    element_t *entry;
+    int level;              /* Number of links in next */
+    struct q_tower *next[]; /* Next tower at levels 1 to level */
+} q_tower_t;
+
+struct q_index {
+    bool stale;    /* Whether the queue changed behind the index's back */
+    int level;     /* Highest level holding a tower */
+    uint64_t seed; /* State of the generator of tower levels */
+    q_tower_t *next[Q_INDEX_MAX_LEVEL]; /* First tower at each level */
+    /* Unused towers of each level, linked through next[0] */
+    q_tower_t *spare[Q_INDEX_MAX_LEVEL + 1];
+};
+
+/* Mark the index of the queue as out of date. Nothing is freed, since the
+ * towers may still point at elements which are gone.
+ */
+static inline void q_index_stale(struct list_head *head)
+{
+    if (head && q_head(head)->index)
+        q_head(head)->index->stale = true;
+}
+
+/* Allocate from the arena of the queue, if it has one */
+static inline void *q_alloc(const queue_head_t *qh, size_t size)
+{
+    return qh->arena ? test_arena_alloc(qh->arena, size) : malloc(size);
+}
+
+/* Release a block from q_alloc() */
+static inline void q_dealloc(const queue_head_t *qh, void *p)
+{
+    if (qh->arena)
+        test_arena_release(p);
+    else
+        free(p);
+}
+
+/* Allocate an element holding a copy of @s. Short strings are stored inline,
+ * so the common case costs a single allocation.
+ */
+static element_t *q_new_element(const queue_head_t *qh, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    element_t *node = (element_t *) q_alloc(qh, sizeof(element_t));
+    if (!node)
+        return NULL;
+
+    if (len <= Q_INLINE_LEN) {
+        node->value = node->inline_value;
+    } else {
+        node->value = q_alloc(qh, len);
+        if (!node->value) {
+            q_dealloc(qh, node);
+            return NULL;
+        }
+    }
+    memcpy(node->value, s, len);
+    return node;
+}
+
 /* Create an empty queue */
 struct list_head *q_new()
 {
-    list_head *head = (list_head *) malloc(sizeof(list_head));
+    queue_head_t *qh = (queue_head_t *) malloc(sizeof(queue_head_t));
 
-    if (!head)
+    if (!qh)
         return NULL;
 
-    INIT_LIST_HEAD(head);
+    INIT_LIST_HEAD(&qh->head);
+    qh->size = 0;
+    qh->arena = NULL;
+    qh->mixed = false;
+    qh->index = NULL;
+
+    return &qh->head;
+}
+
+/* Create an empty queue allocating its elements from an arena */
+struct list_head *q_new_arena()
+{
+    struct list_head *head = q_new();
+    if (!head)
+        return NULL;
 
+    q_head(head)->arena = test_arena_new();
+    if (!q_head(head)->arena) {
+        free(q_head(head));
+        return NULL;
+    }
     return head;
 }
 
@@ -34,66 +122,135 @@ void q_free(struct list_head *head)
 {
     if (!head)
         return;
-    if (list_empty(head)) {
-        free(head);
+
+    q_index_drop(head);
+    queue_head_t *qh = q_head(head);
+    if (!qh->arena || qh->mixed)
+        q_release_list(head);
+    test_arena_free(qh->arena);
+    free(qh);
+}
+
+/* Make @to own the elements about to be moved over from @from. Elements from
+ * the arena of @from stay there, so that arena is handed over as well.
+ */
+static void q_adopt(struct list_head *to, struct list_head *from)
+{
+    queue_head_t *t = q_head(to), *f = q_head(from);
+    if (!f->size)
         return;
+
+    t->mixed = t->mixed || f->mixed || !f->arena || (t->size && !t->arena);
+    if (f->arena) {
+        if (t->arena)
+            test_arena_merge(t->arena, f->arena);
+        else
+            t->arena = f->arena;
+        f->arena = NULL;
+        f->mixed = false;
     }
+}
 
+/* Release every element on a list */
+void q_release_list(struct list_head *list)
+{
     element_t *entry, *safe;
-    list_for_each_entry_safe(entry, safe, head, list)
+    list_for_each_entry_safe(entry, safe, list, list)
         q_release_element(entry);
-    free(head);
+    INIT_LIST_HEAD(list);
 }
 
 /* Insert an element at head of queue */
 bool q_insert_head(struct list_head *head, char *s)
 {
+    q_index_stale(head);
     if (!head)
         return false;
 
-    element_t *node = (element_t *) malloc(sizeof(element_t));
+    element_t *node = q_new_element(q_head(head), s);
     if (!node)
         return false;
 
-    node->value = strdup(s);
-    if (!node->value) {
-        q_release_element(node);
-        return false;
-    }
-
     list_add(&node->list, head);
+    q_head(head)->size++;
     return true;
 }
 
 /* Insert an element at tail of queue */
 bool q_insert_tail(struct list_head *head, char *s)
 {
+    q_index_stale(head);
     if (!head)
         return false;
 
-    element_t *node = (element_t *) malloc(sizeof(element_t));
+    element_t *node = q_new_element(q_head(head), s);
     if (!node)
         return false;
 
-    node->value = strdup(s);
-    if (!node->value) {
-        q_release_element(node);
-        return false;
-    }
-
     list_add_tail(&node->list, head);
+    q_head(head)->size++;
+    return true;
+}
+
+/* Insert elements for s[0..n) at head of queue, or at its tail, as n calls
+ * to q_insert_head()/q_insert_tail() would. The size follows every insertion,
+ * so the queue stays whole if the caller is interrupted. On allocation
+ * failure, the elements inserted so far are released again.
+ */
+static bool q_insert_many(struct list_head *head, char **s, int n, bool tail)
+{
+    queue_head_t *qh = q_head(head);
+    for (int i = 0; i < n; i++) {
+        element_t *node = q_new_element(qh, s[i]);
+        if (!node) {
+            while (i--) {
+                struct list_head *l = tail ? head->prev : head->next;
+                list_del(l);
+                qh->size--;
+                q_release_element(list_entry(l, element_t, list));
+            }
+            return false;
+        }
+        if (tail)
+            list_add_tail(&node->list, head);
+        else
+            list_add(&node->list, head);
+        qh->size++;
+    }
     return true;
 }
 
+/* Insert n elements at head of queue */
+bool q_insert_head_many(struct list_head *head, char **s, int n)
+{
+    q_index_stale(head);
+    if (!head || n < 0)
+        return false;
+
+    return q_insert_many(head, s, n, false);
+}
+
+/* Insert n elements at tail of queue */
+bool q_insert_tail_many(struct list_head *head, char **s, int n)
+{
+    q_index_stale(head);
+    if (!head || n < 0)
+        return false;
+
+    return q_insert_many(head, s, n, true);
+}
+
 /* Remove an element from head of queue */
 // cppcheck-suppress constParameterPointer
 element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
 {
+    q_index_stale(head);
     if (!head || list_empty(head))
         return NULL;
 
     element_t *entry = list_first_entry(head, element_t, list);
     list_del(&entry->list);
+    q_head(head)->size--;
 
     if (sp) {
         strncpy(sp, entry->value, bufsize - 1);
@@ -106,11 +263,13 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize)
 // cppcheck-suppress constParameterPointer
 element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
 {
+    q_index_stale(head);
     if (!head || list_empty(head))
         return NULL;
 
     element_t *entry = list_last_entry(head, element_t, list);
     list_del(&entry->list);
+    q_head(head)->size--;
 
     if (sp) {
         strncpy(sp, entry->value, bufsize - 1);
@@ -120,22 +279,63 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize)
     return entry;
 }
 
+/* Detach the first n elements of queue */
+int q_cut_head(struct list_head *head, struct list_head *list, int n)
+{
+    INIT_LIST_HEAD(list);
+    q_index_stale(head);
+    if (!head || list_empty(head) || n <= 0)
+        return 0;
+
+    int size = q_size(head);
+    if (n >= size) {
+        list_splice_init(head, list);
+        q_head(head)->size = 0;
+        return size;
+    }
+
+    /* Find the n-th node from whichever end is closer */
+    list_head *node = head;
+    if (n <= size / 2) {
+        for (int i = 0; i < n; i++)
+            node = node->next;
+    } else {
+        for (int i = size; i >= n; i--)
+            node = node->prev;
+    }
+
+    list_cut_position(list, head, node);
+    q_head(head)->size -= n;
+    return n;
+}
+
+/* Remove the first n elements of queue as a new queue */
+struct list_head *q_remove_head_n(struct list_head *head, int n)
+{
+    if (!head)
+        return NULL;
+
+    struct list_head *batch = q_new();
+    if (!batch)
+        return NULL;
+
+    q_head(batch)->size = q_cut_head(head, batch, n);
+    return batch;
+}
+
 /* Return number of elements in queue */
 int q_size(struct list_head *head)
 {
     if (!head)
         return 0;
 
-    int len = 0;
-    list_head *li;
-    list_for_each(li, head)
-        len++;
-    return len;
+    return q_head(head)->size;
 }
 
 /* Delete the middle node in queue */
 bool q_delete_mid(struct list_head *head)
 {
+    q_index_stale(head);
     // https://leetcode.com/problems/delete-the-middle-node-of-a-linked-list/
     if (!head || list_empty(head))
         return false;
@@ -147,6 +347,7 @@ bool q_delete_mid(struct list_head *head)
         fast = fast->next->next;
     }
     list_del(slow);
+    q_head(head)->size--;
     element_t *str = list_entry(slow, element_t, list);
     q_release_element(str);
 
@@ -157,6 +358,7 @@ bool q_delete_mid(struct list_head *head)
 // cppcheck-suppress constParameterPointer
 bool q_delete_dup(struct list_head *head)
 {
+    q_index_stale(head);
     // https://leetcode.com/problems/remove-duplicates-from-sorted-list-ii/
     if (!head || list_empty(head))
         return false;
@@ -171,6 +373,7 @@ bool q_delete_dup(struct list_head *head)
         // head -> B       -> C -> ... -> head
         if (cur || last) {
             list_del(&entry->list);
+            q_head(head)->size--;
             q_release_element(entry);
             last = cur;
         }
@@ -178,9 +381,134 @@ bool q_delete_dup(struct list_head *head)
     return true;
 }
 
+/* Slots of the dedup set are probed DEDUP_GROUP at a time, by loading their
+ * tags as a single word.
+ */
+#define DEDUP_GROUP 8
+#define DEDUP_ONES 0x0101010101010101ULL
+#define DEDUP_HIGHS 0x8080808080808080ULL
+
+typedef struct {
+    element_t *first; /* First node seen with the string of the slot */
+    bool dup;         /* Whether a later node had the same string */
+} dedup_slot_t;
+
+static inline uint64_t hash_ror_uint64(const uint64_t x, const uint32_t bits)
+{
+    return (x >> bits) | x << (64 - bits);
+}
+
+/* stress_hash_mulxror64() of tools/fmtscan.c, keeping all 64 bits */
+static uint64_t hash_mulxror64(const char *str, const size_t len)
+{
+    uint64_t hash = len;
+
+    for (size_t i = len >> 3; i; i--) {
+        uint64_t v;
+
+        memcpy(&v, str, sizeof(v));
+        str += sizeof(v);
+        hash *= v;
+        hash ^= hash_ror_uint64(hash, 40);
+    }
+    for (size_t i = len & 7; *str && i; i--) {
+        hash *= (uint8_t) *str++;
+        hash ^= hash_ror_uint64(hash, 5);
+    }
+    /* Short strings leave the high bits poorly mixed, and both the group and
+     * the tag are taken from there.
+     */
+    return hash * 0x9e3779b97f4a7c15ULL;
+}
+
+/* Mark the bytes of @x which are zero, lowest first. Bytes above a marked one
+ * may be marked by mistake.
+ */
+static inline uint64_t dedup_zero_bytes(uint64_t x)
+{
+    return (x - DEDUP_ONES) & ~x & DEDUP_HIGHS;
+}
+
+/* Delete all nodes that have duplicate string, in any order */
+bool q_delete_dup_hash(struct list_head *head)
+{
+    q_index_stale(head);
+    if (!head || list_empty(head))
+        return false;
+
+    /* Keep the set at most half full, so that every probe ends soon */
+    size_t n = q_size(head), groups = 1;
+    while (groups * DEDUP_GROUP < 2 * n)
+        groups <<= 1;
+    size_t nslots = groups * DEDUP_GROUP;
+
+    dedup_slot_t *slots = malloc(nslots * (sizeof(dedup_slot_t) + 1));
+    if (!slots)
+        return false;
+    /* A tag is zero for a free slot, else seven bits of the hash */
+    uint8_t *tags = (uint8_t *) (slots + nslots);
+    memset(tags, 0, nslots);
+
+    element_t *entry, *safe;
+    list_for_each_entry_safe(entry, safe, head, list) {
+        uint64_t hash = hash_mulxror64(entry->value, strlen(entry->value));
+        uint8_t tag = 0x80 | (hash >> 57);
+        size_t g = (hash >> 32) & (groups - 1);
+
+        for (;; g = (g + 1) & (groups - 1)) {
+            uint8_t *group = tags + g * DEDUP_GROUP;
+            uint64_t word;
+            memcpy(&word, group, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            word = __builtin_bswap64(word);
+#endif
+            uint64_t match = dedup_zero_bytes(word ^ (tag * DEDUP_ONES));
+            dedup_slot_t *slot = NULL;
+            for (; match; match &= match - 1) {
+                size_t i = g * DEDUP_GROUP + (__builtin_ctzll(match) >> 3);
+                if (tags[i] == tag && !strcmp(slots[i].first->value,
+                                              entry->value)) {
+                    slot = &slots[i];
+                    break;
+                }
+            }
+            if (slot) {
+                slot->dup = true;
+                list_del(&entry->list);
+                q_head(head)->size--;
+                q_release_element(entry);
+                break;
+            }
+
+            /* Slots are filled in probe order, so a free one means the
+             * string is not in the set.
+             */
+            uint64_t empty = dedup_zero_bytes(word);
+            if (empty) {
+                size_t i = g * DEDUP_GROUP + (__builtin_ctzll(empty) >> 3);
+                tags[i] = tag;
+                slots[i].first = entry;
+                slots[i].dup = false;
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nslots; i++) {
+        if (tags[i] && slots[i].dup) {
+            list_del(&slots[i].first->list);
+            q_head(head)->size--;
+            q_release_element(slots[i].first);
+        }
+    }
+    free(slots);
+    return true;
+}
+
 /* Swap every two adjacent nodes */
 void q_swap(struct list_head *head)
 {
+    q_index_stale(head);
     // https://leetcode.com/problems/swap-nodes-in-pairs/
     if (!head || list_empty(head) || list_is_singular(head))
         return;
@@ -199,6 +527,7 @@ void q_swap(struct list_head *head)
 /* Reverse elements in queue */
 void q_reverse(struct list_head *head)
 {
+    q_index_stale(head);
     if (!head || list_empty(head) || list_is_singular(head))
         return;
 
@@ -215,31 +544,68 @@ void q_reverse(struct list_head *head)
 /* Reverse the nodes of the list k at a time */
 void q_reverseK(struct list_head *head, int k)
 {
+    q_index_stale(head);
     // https://leetcode.com/problems/reverse-nodes-in-k-group/
-    int turn = q_size(head) / k;
-    list_head *front = head->next->next;
-    list_head *last = head->next;
-
-    for (size_t i = 0; i < turn; i++) {
-        list_head *ll = last->prev;
-        // Head -> A(last) -> B(front) -> C -> D -> E -> F -> Head
-        // Head <- B(front) <- A(last) <- Head
-        for (size_t j = 0; j < k; j++) {
-            last->next = last->prev;
-            last->prev = front;
-            front = front->next;
-            last = last->prev;
+    if (!head || list_empty(head) || k <= 1)
+        return;
+
+    /* Move every node right behind the node preceding its group, which
+     * reverses the group as it is scanned.
+     */
+    list_head *anchor = head, *first = NULL, *node, *next;
+    int cnt = 0;
+    for (node = head->next; node != head; node = next) {
+        next = node->next;
+        if (!cnt)
+            first = node;
+        list_move(node, anchor);
+        if (++cnt == k) {
+            anchor = first;
+            cnt = 0;
         }
-        list_head *ff = last;
-        last = ll->next;
-        front = ff->prev;
-        last->next = ff;
-        ff->prev = last;
-        front->prev = ll;
-        ll->next = front;
-        last = ff;
-        front = ff->next;
     }
+
+    /* The last group turned out short, so put it back in original order */
+    for (node = anchor->next; cnt--; node = next) {
+        next = node->next;
+        list_move(node, anchor);
+    }
+}
+
+/* Rotate the queue by k positions */
+void q_rotate(struct list_head *head, int k)
+{
+    q_index_stale(head);
+    if (!head || list_empty(head) || list_is_singular(head))
+        return;
+
+    int n = q_size(head);
+    k %= n;
+    if (k < 0)
+        k += n;
+    if (!k)
+        return;
+
+    /* Find the k-th node from whichever end is closer */
+    list_head *node = head;
+    if (k <= n / 2) {
+        for (int i = 0; i < k; i++)
+            node = node->next;
+    } else {
+        for (int i = n; i >= k; i--)
+            node = node->prev;
+    }
+
+    /* Relinking the head right after it is all it takes */
+    list_del(head);
+    list_add(head, node);
+}
+
+/* Whether @a may precede @b in an ascending/descending queue */
+static inline bool q_in_order(const char *a, const char *b, bool descend)
+{
+    int cmp = strcmp(a, b);
+    return descend ? cmp >= 0 : cmp <= 0;
 }
 
 static struct list_head *merge(list_head *a, list_head *b, bool descend)
@@ -250,7 +616,7 @@ static struct list_head *merge(list_head *a, list_head *b, bool descend)
         /* if equal, take 'a' -- important for sort stability */
         const char *l_value = list_entry(a, element_t, list)->value,
                    *r_value = list_entry(b, element_t, list)->value;
-        if (strcmp(l_value, r_value) == descend) {
+        if (q_in_order(l_value, r_value, descend)) {
             *tail = a;
             tail = &a->next;
             a = a->next;
@@ -282,7 +648,7 @@ static void merge_final(list_head *head,
         /* if equal, take 'a' -- important for sort stability */
         const char *l_value = list_entry(a, element_t, list)->value,
                    *r_value = list_entry(b, element_t, list)->value;
-        if (strcmp(l_value, r_value) == descend) {
+        if (q_in_order(l_value, r_value, descend)) {
             tail->next = a;
             a->prev = tail;
             tail = a;
@@ -314,9 +680,14 @@ static void merge_final(list_head *head,
     head->prev = tail;
 }
 
-/* Sort elements of queue in ascending/descending order */
-void q_sort(struct list_head *head, bool descend)
+/* Merge sort the list at @head. Unlike q_sort(), @head need not belong to a
+ * queue_head_t, so that it also serves for the runs of q_sort_parallel().
+ */
+static void list_merge_sort(struct list_head *head, bool descend)
 {
+    if (!head)
+        return;
+
     struct list_head *list = head->next, *pending = NULL;
     size_t count = 0; /* Count of pending */
 
@@ -336,7 +707,7 @@ void q_sort(struct list_head *head, bool descend)
         if (bits) {
             struct list_head *a = *tail, *b = a->prev;
 
-            a = q_merge_two(b, a, descend);
+            a = merge(b, a, descend);
             /* Install the merged result in place of the inputs */
             a->prev = b->prev;
             *tail = a;
@@ -358,61 +729,308 @@ void q_sort(struct list_head *head, bool descend)
 
         if (!next)
             break;
-        list = q_merge_two(pending, list, descend);
+        list = merge(pending, list, descend);
         pending = next;
     }
     /* The final merge, rebuilding prev links */
     merge_final(head, pending, list, descend);
 }
 
-/* Remove every node which has a node with a strictly less value anywhere to
- * the right side of it */
-// cppcheck-suppress constParameterPointer
-int q_ascend(struct list_head *head)
+/* Sort elements of queue in ascending/descending order */
+void q_sort(struct list_head *head, bool descend)
 {
-    // https://leetcode.com/problems/remove-nodes-from-linked-list/
-    if (!head || list_empty(head))
+    q_index_stale(head);
+    list_merge_sort(head, descend);
+}
+
+/* Threads used by q_sort_parallel are capped, and each one gets at least this
+ * many elements, otherwise the thread start-up would outweigh the sorting.
+ */
+#define SORT_MAX_THREADS 64
+#define SORT_MIN_PER_THREAD 4096
+
+typedef struct {
+    struct list_head run;    /* Contiguous slice of the queue */
+    struct list_head *other; /* Run to merge into this one, NULL to sort */
+    bool descend;
+} sort_task_t;
+
+/* Merge sorted run b into sorted run a, leaving b empty */
+static void merge_runs(list_head *a, list_head *b, bool descend)
+{
+    list_head *la = a->next, *lb = b->next;
+
+    /* merge_final() expects two null-terminated lists */
+    a->prev->next = NULL;
+    b->prev->next = NULL;
+    merge_final(a, la, lb, descend);
+    INIT_LIST_HEAD(b);
+}
+
+static void *sort_worker(void *arg)
+{
+    sort_task_t *task = arg;
+    if (task->other)
+        merge_runs(&task->run, task->other, task->descend);
+    else
+        list_merge_sort(&task->run, task->descend);
+    return NULL;
+}
+
+/* Run tasks[0..count) concurrently, the first one on the calling thread */
+static void sort_run_tasks(sort_task_t **tasks, int count)
+{
+    pthread_t tid[SORT_MAX_THREADS];
+    bool spawned[SORT_MAX_THREADS] = {false};
+
+    /* Workers inherit a mask that keeps SIGALRM on the calling thread */
+    sigset_t set, old;
+    sigemptyset(&set);
+    sigaddset(&set, SIGALRM);
+    pthread_sigmask(SIG_BLOCK, &set, &old);
+    for (int i = 1; i < count; i++)
+        spawned[i] = !pthread_create(&tid[i], NULL, sort_worker, tasks[i]);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    sort_worker(tasks[0]);
+    for (int i = 1; i < count; i++) {
+        if (spawned[i])
+            pthread_join(tid[i], NULL);
+        else
+            sort_worker(tasks[i]);
+    }
+}
+
+/* Sort elements of queue on several threads */
+void q_sort_parallel(struct list_head *head, bool descend, int nthreads)
+{
+    q_index_stale(head);
+    if (!head || list_empty(head) || list_is_singular(head))
+        return;
+
+    int n = q_size(head);
+    if (nthreads > SORT_MAX_THREADS)
+        nthreads = SORT_MAX_THREADS;
+    if (nthreads > n / SORT_MIN_PER_THREAD)
+        nthreads = n / SORT_MIN_PER_THREAD;
+    if (nthreads < 2) {
+        q_sort(head, descend);
+        return;
+    }
+
+    /* Cut the queue into nthreads runs of (almost) equal length */
+    sort_task_t tasks[SORT_MAX_THREADS];
+    sort_task_t *batch[SORT_MAX_THREADS];
+    for (int i = 0; i < nthreads; i++) {
+        int len = n / nthreads + (i < n % nthreads);
+        list_head *node = head;
+        while (len--)
+            node = node->next;
+        list_cut_position(&tasks[i].run, head, node);
+        tasks[i].other = NULL;
+        tasks[i].descend = descend;
+        batch[i] = &tasks[i];
+    }
+    sort_run_tasks(batch, nthreads);
+
+    /* Merge neighbouring runs level by level. The left run always absorbs
+     * the right one, so equal strings keep their original order.
+     */
+    for (int step = 1; step < nthreads; step <<= 1) {
+        int count = 0;
+        for (int i = 0; i + step < nthreads; i += step << 1) {
+            tasks[i].other = &tasks[i + step].run;
+            batch[count++] = &tasks[i];
+        }
+        sort_run_tasks(batch, count);
+    }
+
+    list_splice(&tasks[0].run, head);
+}
+
+/* Sort key: the first 8 bytes of the string packed big-endian, so that
+ * comparing prefixes as integers agrees with strcmp() on those bytes.
+ */
+typedef struct {
+    uint64_t prefix;
+    element_t *entry;
+} sort_key_t;
+
+/* Below this many elements, runs are sorted by insertion before merging */
+#define SORT_KEY_RUN 8
+
+static inline uint64_t key_prefix(const char *s)
+{
+    uint64_t k = 0;
+    for (int i = 0; i < 8; i++) {
+        k = k << 8 | (unsigned char) *s;
+        if (*s)
+            s++;
+    }
+    return k;
+}
+
+static inline int key_cmp(const sort_key_t *a, const sort_key_t *b)
+{
+    if (a->prefix != b->prefix)
+        return a->prefix < b->prefix ? -1 : 1;
+    /* A zero last byte means both strings end within the prefix */
+    if (!(a->prefix & 0xff))
         return 0;
+    return strcmp(a->entry->value + 8, b->entry->value + 8);
+}
 
-    element_t *each, *safe;
-    list_head *pending = q_new();
-    int count = 0;
+static inline bool key_in_order(const sort_key_t *a,
+                                const sort_key_t *b,
+                                bool descend)
+{
+    int cmp = key_cmp(a, b);
+    return descend ? cmp >= 0 : cmp <= 0;
+}
 
-    list_for_each_entry_safe(each, safe, head, list) {
-        count++;
-        if (&safe->list != head && strcmp(each->value, safe->value) > 0) {
-            list_move(&safe->list, pending);
-            safe = each;
-            count--;
+/* Stable bottom-up merge sort of keys[0..n), using tmp as scratch space.
+ * Return whichever of the two arrays holds the result.
+ */
+static sort_key_t *key_sort(sort_key_t *keys,
+                            sort_key_t *tmp,
+                            size_t n,
+                            bool descend)
+{
+    for (size_t lo = 0; lo < n; lo += SORT_KEY_RUN) {
+        size_t hi = lo + SORT_KEY_RUN < n ? lo + SORT_KEY_RUN : n;
+        for (size_t i = lo + 1; i < hi; i++) {
+            sort_key_t k = keys[i];
+            size_t j = i;
+            for (; j > lo && !key_in_order(&keys[j - 1], &k, descend); j--)
+                keys[j] = keys[j - 1];
+            keys[j] = k;
         }
     }
-    q_free(pending);
-    return count;
+
+    for (size_t width = SORT_KEY_RUN; width < n; width <<= 1) {
+        for (size_t lo = 0; lo < n; lo += width << 1) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = mid + width < n ? mid + width : n;
+            size_t i = lo, j = mid, k = lo;
+            /* if equal, take from the left run -- important for stability */
+            while (i < mid && j < hi)
+                tmp[k++] = key_in_order(&keys[i], &keys[j], descend)
+                               ? keys[i++]
+                               : keys[j++];
+            while (i < mid)
+                tmp[k++] = keys[i++];
+            while (j < hi)
+                tmp[k++] = keys[j++];
+        }
+        sort_key_t *swap = keys;
+        keys = tmp;
+        tmp = swap;
+    }
+    return keys;
 }
 
-/* Remove every node which has a node with a strictly greater value anywhere
- * to the right side of it */
-int q_descend(struct list_head *head)
+/* Sort elements of queue through an array of key prefixes */
+void q_sort_key(struct list_head *head, bool descend)
 {
-    // https://leetcode.com/problems/remove-nodes-from-linked-list/
+    q_index_stale(head);
+    if (!head || list_empty(head) || list_is_singular(head))
+        return;
+
+    size_t n = q_size(head);
+    sort_key_t *keys = malloc(2 * n * sizeof(sort_key_t));
+    if (!keys) {
+        q_sort(head, descend);
+        return;
+    }
+
+    size_t i = 0;
+    element_t *entry;
+    list_for_each_entry(entry, head, list) {
+        keys[i].prefix = key_prefix(entry->value);
+        keys[i++].entry = entry;
+    }
+
+    sort_key_t *sorted = key_sort(keys, keys + n, n, descend);
+
+    INIT_LIST_HEAD(head);
+    for (i = 0; i < n; i++)
+        list_add_tail(&sorted[i].entry->list, head);
+    free(keys);
+}
+
+/* Order two strings, settling most pairs on their first byte without a call */
+static inline int q_value_cmp(const char *a, const char *b)
+{
+    if (*a != *b)
+        return (unsigned char) *a - (unsigned char) *b;
+    return strcmp(a, b);
+}
+
+/* Walk the queue from the tail, keeping the extremum of the values seen so
+ * far. A node beyond the extremum (greater if @descend is false, less
+ * otherwise) has a node to its right which rules it out, and is moved to
+ * @removed in queue order; any other node becomes the new extremum.
+ */
+static int q_monotonic_cut(struct list_head *head,
+                           struct list_head *removed,
+                           bool descend)
+{
+    INIT_LIST_HEAD(removed);
+    q_index_stale(head);
     if (!head || list_empty(head))
         return 0;
 
-    int count = q_size(head);
-    list_head *prev = head->prev;
-    list_head *pending;
-    while (prev->prev != head) {
-        if (strcmp(list_entry(prev, element_t, list)->value,
-                   list_entry(prev->prev, element_t, list)->value) > 0) {
-            pending = prev->prev;
-            list_del(pending);
-            element_t *str = list_entry(pending, element_t, list);
-            q_release_element(str);
-            count--;
+    list_head *ext = head->prev, *node = ext->prev;
+    int removed_cnt = 0;
+    while (node != head) {
+        list_head *prev = node->prev;
+        int cmp = q_value_cmp(list_entry(node, element_t, list)->value,
+                              list_entry(ext, element_t, list)->value);
+        if (descend ? cmp < 0 : cmp > 0) {
+            list_move(node, removed);
+            removed_cnt++;
         } else {
-            prev = prev->prev;
+            ext = node;
         }
+        node = prev;
     }
+    q_head(head)->size -= removed_cnt;
+    return q_size(head);
+}
+
+/* Remove every node which has a node with a strictly less value anywhere to
+ * the right side of it, handing them over on a list */
+int q_ascend_cut(struct list_head *head, struct list_head *list)
+{
+    return q_monotonic_cut(head, list, false);
+}
+
+/* Remove every node which has a node with a strictly greater value anywhere
+ * to the right side of it, handing them over on a list */
+int q_descend_cut(struct list_head *head, struct list_head *list)
+{
+    return q_monotonic_cut(head, list, true);
+}
+
+/* Remove every node which has a node with a strictly less value anywhere to
+ * the right side of it */
+int q_ascend(struct list_head *head)
+{
+    // https://leetcode.com/problems/remove-nodes-from-linked-list/
+    LIST_HEAD(removed);
+    int count = q_monotonic_cut(head, &removed, false);
+    q_release_list(&removed);
+    return count;
+}
+
+/* Remove every node which has a node with a strictly greater value anywhere
+ * to the right side of it */
+int q_descend(struct list_head *head)
+{
+    // https://leetcode.com/problems/remove-nodes-from-linked-list/
+    LIST_HEAD(removed);
+    int count = q_monotonic_cut(head, &removed, true);
+    q_release_list(&removed);
     return count;
 }
 
@@ -423,16 +1041,22 @@ static int q_merge_two(struct list_head *ll1,
     if (!ll1 || !ll2)
         return q_size(ll1 ? ll1 : ll2);
 
+    q_adopt(ll1, ll2);
+    q_index_stale(ll1);
+    q_index_stale(ll2);
+    int size = q_size(ll1) + q_size(ll2);
+    q_head(ll1)->size = size;
+    q_head(ll2)->size = 0;
+
     // {ll1, ll2} = 2'b00, 2'b01, 2'b10
     if (list_empty(ll1) || list_empty(ll2)) {
         if (list_empty(ll1))
             list_splice_init(ll2, ll1);
-        return q_size(ll1);
+        return size;
     }
 
-    int size = 0;
     LIST_HEAD(dummy);
-    for (; !list_empty(ll1) && !list_empty(ll2); ++size) {
+    while (!list_empty(ll1) && !list_empty(ll2)) {
         element_t *entry = list_first_entry(ll1, element_t, list);
         element_t *safe = list_first_entry(ll2, element_t, list);
         int cmp = strcmp(entry->value, safe->value);
@@ -445,13 +1069,80 @@ static int q_merge_two(struct list_head *ll1,
     }
 
     list_head *pending = list_empty(ll1) ? ll2 : ll1;
-    size += q_size(pending);
-
     list_splice_tail_init(pending, &dummy);
     list_splice_init(&dummy, ll1);
     return size;
 }
 
+/* Queues merged through the heap are capped, larger chains are merged
+ * pairwise instead so that no allocation is needed.
+ */
+#define MERGE_HEAP_MAX 256
+
+/* Cursor into one of the queues being merged */
+typedef struct {
+    list_head *node; /* Next node to be merged */
+    list_head *q;    /* Queue the node belongs to */
+    int idx;         /* Position of the queue in the chain */
+} merge_src_t;
+
+/* Order by value, and by chain position for equal values to keep stable */
+static inline bool merge_src_less(const merge_src_t *a,
+                                  const merge_src_t *b,
+                                  bool descend)
+{
+    int cmp = strcmp(list_entry(a->node, element_t, list)->value,
+                     list_entry(b->node, element_t, list)->value);
+    if (cmp)
+        return descend ? cmp > 0 : cmp < 0;
+    return a->idx < b->idx;
+}
+
+static void merge_heap_down(merge_src_t *heap, int n, int i, bool descend)
+{
+    merge_src_t src = heap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n &&
+            merge_src_less(&heap[child + 1], &heap[child], descend))
+            child++;
+        if (!merge_src_less(&heap[child], &src, descend))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = src;
+}
+
+/* Merge all the queues of the chain pairwise, in rounds of doubling distance */
+int q_merge_pairwise(struct list_head *head, bool descend)
+{
+    if (!head || list_empty(head))
+        return 0;
+
+    queue_contex_t *first = list_first_entry(head, queue_contex_t, chain);
+    bool merged = true;
+    for (int step = 1; merged; step <<= 1) {
+        merged = false;
+        list_head *cur = head->next;
+        while (cur != head) {
+            queue_contex_t *left = list_entry(cur, queue_contex_t, chain);
+            for (int i = 0; i < step && cur != head; i++)
+                cur = cur->next;
+            if (cur == head)
+                break;
+            queue_contex_t *right = list_entry(cur, queue_contex_t, chain);
+            q_merge_two(left->q, right->q, descend);
+            merged = true;
+            for (int i = 0; i < step && cur != head; i++)
+                cur = cur->next;
+        }
+    }
+    return q_size(first->q);
+}
+
 /* Merge all the queues into one sorted queue, which is in
  * ascending/descending order */
 int q_merge(struct list_head *head, bool descend)
@@ -460,38 +1151,455 @@ int q_merge(struct list_head *head, bool descend)
     if (!head || list_empty(head))
         return 0;
 
-    if (list_is_singular(head))
-        return q_size(list_first_entry(head, queue_contex_t, chain)->q);
+    queue_contex_t *first = list_first_entry(head, queue_contex_t, chain);
+    if (list_is_singular(head) || !first->q)
+        return q_size(first->q);
+
+    merge_src_t heap[MERGE_HEAP_MAX];
+    int n = 0, idx = 0, size = 0;
+    queue_contex_t *ctx;
+    list_for_each_entry(ctx, head, chain) {
+        if (n == MERGE_HEAP_MAX)
+            return q_merge_pairwise(head, descend);
+        if (ctx->q && !list_empty(ctx->q)) {
+            heap[n].node = ctx->q->next;
+            heap[n].q = ctx->q;
+            heap[n++].idx = idx;
+        }
+        idx++;
+    }
+    for (int i = n / 2 - 1; i >= 0; i--)
+        merge_heap_down(heap, n, i, descend);
+
+    /* Repeatedly move the smallest head node over to the output list */
+    LIST_HEAD(out);
+    while (n) {
+        list_head *node = heap[0].node;
+        heap[0].node = node->next;
+        if (heap[0].node == heap[0].q)
+            heap[0] = heap[--n];
+        list_move_tail(node, &out);
+        size++;
+        if (n)
+            merge_heap_down(heap, n, 0, descend);
+    }
+
+    list_for_each_entry(ctx, head, chain) {
+        if (ctx->q && ctx != first)
+            q_adopt(first->q, ctx->q);
+        q_index_stale(ctx->q);
+    }
+    list_for_each_entry(ctx, head, chain) {
+        if (ctx->q)
+            q_head(ctx->q)->size = 0;
+    }
+    list_splice(&out, first->q);
+    q_head(first->q)->size = size;
+    return size;
+}
+
+/* Random numbers are drawn from the PRNG in batches of this many */
+#define SHUFFLE_BATCH 256
+
+/* q_shuffle_merge shuffles blocks of this many nodes in a fixed array */
+#define SHUFFLE_BLOCK 1024
 
-    int count = 0;
+typedef struct {
+    uint32_t buf[SHUFFLE_BATCH];
+    int left;
+} rand_batch_t;
 
-    list_head *first = head->next;
-    queue_contex_t *first_q = list_entry(first, queue_contex_t, chain);
+/* Return a random number in the range [0, bound - 1] */
+static inline uint32_t rand_below(rand_batch_t *rb, uint32_t bound)
+{
+    if (!rb->left) {
+        rand_func[prng]((uint8_t *) rb->buf, sizeof(rb->buf));
+        rb->left = SHUFFLE_BATCH;
+    }
+    /* Scale instead of taking the modulo, which avoids a division */
+    return ((uint64_t) rb->buf[--rb->left] * bound) >> 32;
+}
 
-    for (list_head *next = first->next; next != head; next = next->next) {
-        queue_contex_t *next_q = list_entry(next, queue_contex_t, chain);
-        count = q_merge_two(first_q->q, next_q->q, descend);
+/* Interleave the shuffled null-terminated lists a and b of na and nb nodes,
+ * taking the next node from each with probability proportional to its
+ * remaining length. The result is a uniformly shuffled list.
+ */
+static list_head *shuffle_interleave(list_head *a,
+                                     int na,
+                                     list_head *b,
+                                     int nb,
+                                     rand_batch_t *rb)
+{
+    list_head *result, **tail = &result;
+    while (na && nb) {
+        if (rand_below(rb, na + nb) < (uint32_t) na) {
+            *tail = a;
+            a = a->next;
+            na--;
+        } else {
+            *tail = b;
+            b = b->next;
+            nb--;
+        }
+        tail = &(*tail)->next;
     }
-    return count;
+    *tail = na ? a : b;
+    return result;
+}
+
+/* Shuffle the queue without any extra memory */
+void q_shuffle_merge(struct list_head *head)
+{
+    q_index_stale(head);
+    if (!head || list_empty(head) || list_is_singular(head))
+        return;
+
+    /* The queue is consumed in blocks that are shuffled with Fisher-Yates in
+     * a fixed-size array. Then, bottom-up like q_sort, runs of equal length
+     * are interleaved as soon as they appear, so at most one run per bit of
+     * the queue size is pending.
+     */
+    list_head *block[SHUFFLE_BLOCK];
+    struct {
+        list_head *list;
+        int len;
+    } runs[sizeof(int) * 8];
+    int depth = 0;
+    rand_batch_t rb = {.left = 0};
+
+    head->prev->next = NULL;
+    for (list_head *node = head->next; node;) {
+        int len = 0;
+        for (; node && len < SHUFFLE_BLOCK; node = node->next)
+            block[len++] = node;
+        for (int i = len - 1; i > 0; i--) {
+            uint32_t j = rand_below(&rb, i + 1);
+            list_head *tmp = block[i];
+            block[i] = block[j];
+            block[j] = tmp;
+        }
+        for (int i = 0; i < len - 1; i++)
+            block[i]->next = block[i + 1];
+        block[len - 1]->next = NULL;
+
+        runs[depth].list = block[0];
+        runs[depth++].len = len;
+        while (depth > 1 && runs[depth - 1].len == runs[depth - 2].len) {
+            depth--;
+            runs[depth - 1].list =
+                shuffle_interleave(runs[depth - 1].list, runs[depth - 1].len,
+                                   runs[depth].list, runs[depth].len, &rb);
+            runs[depth - 1].len <<= 1;
+        }
+    }
+    while (depth > 1) {
+        depth--;
+        runs[depth - 1].list =
+            shuffle_interleave(runs[depth - 1].list, runs[depth - 1].len,
+                               runs[depth].list, runs[depth].len, &rb);
+        runs[depth - 1].len += runs[depth].len;
+    }
+
+    /* Rebuild the prev links and close the circle */
+    list_head *prev = head, *list = runs[0].list;
+    for (; list; prev = list, list = list->next) {
+        prev->next = list;
+        list->prev = prev;
+    }
+    prev->next = head;
+    head->prev = prev;
 }
 
+/* Shuffle the queue with Fisher-Yates over an array of its nodes */
 void q_shuffle(list_head *head)
 {
+    q_index_stale(head);
     if (!head || list_empty(head) || list_is_singular(head))
         return;
 
-    LIST_HEAD(dummy);
-    for (int i = q_size(head); i > 0; i--) {
-        /* Generate a random number in the range [0, i-1] */
-        uint32_t j;
-        rand_func[prng]((uint8_t *) &j, sizeof(uint32_t));
-        j = j % i;
-
-        // Swap indices q[i] and q[j]
-        list_head *node = head->next;
-        while ((int) j-- > 0 && node != head)
-            node = node->next;
-        list_move(node, &dummy);
+    int n = q_size(head);
+    list_head **nodes = malloc(n * sizeof(list_head *));
+    if (!nodes) {
+        q_shuffle_merge(head);
+        return;
+    }
+
+    int i = 0;
+    list_head *node;
+    list_for_each(node, head)
+        nodes[i++] = node;
+
+    rand_batch_t rb = {.left = 0};
+    for (i = n - 1; i > 0; i--) {
+        /* Swap nodes[i] with a random node in nodes[0..i] */
+        uint32_t j = rand_below(&rb, i + 1);
+        node = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = node;
+    }
+
+    INIT_LIST_HEAD(head);
+    for (i = 0; i < n; i++)
+        list_add_tail(nodes[i], head);
+    free(nodes);
+}
+
+/* Draw the level of a new tower, zero meaning the node gets none */
+static int q_index_random_level(q_index_t *idx)
+{
+    /* xorshift64* */
+    idx->seed ^= idx->seed >> 12;
+    idx->seed ^= idx->seed << 25;
+    idx->seed ^= idx->seed >> 27;
+    uint64_t r = idx->seed * 0x2545f4914f6cdd1dULL;
+
+    /* Each pair of trailing zero bits is one more level */
+    return __builtin_ctzll(r | 1ULL << (2 * Q_INDEX_MAX_LEVEL)) / 2;
+}
+
+/* Take a tower of the given level, reusing a spare one if possible */
+static q_tower_t *q_tower_new(q_index_t *idx, int level)
+{
+    q_tower_t *t = idx->spare[level];
+    if (t) {
+        idx->spare[level] = t->next[0];
+        return t;
+    }
+
+    t = malloc(sizeof(q_tower_t) + level * sizeof(q_tower_t *));
+    if (t)
+        t->level = level;
+    return t;
+}
+
+/* Move every tower to the spares. Only the level 1 links are followed, so
+ * this is safe even when elements the towers point at are gone.
+ */
+static void q_index_clear(q_index_t *idx)
+{
+    q_tower_t *t = idx->next[0];
+    while (t) {
+        q_tower_t *next = t->next[0];
+        t->next[0] = idx->spare[t->level];
+        idx->spare[t->level] = t;
+        t = next;
+    }
+    memset(idx->next, 0, sizeof(idx->next));
+    idx->level = 0;
+}
+
+/* Put towers over the nodes of the queue again, with fresh levels */
+static bool q_index_layout(struct list_head *head, q_index_t *idx)
+{
+    q_index_clear(idx);
+
+    /* Link to fill in at each level, for the next tower reaching it */
+    q_tower_t **last[Q_INDEX_MAX_LEVEL];
+    for (int i = 0; i < Q_INDEX_MAX_LEVEL; i++)
+        last[i] = &idx->next[i];
+
+    bool ok = true;
+    element_t *entry;
+    list_for_each_entry(entry, head, list) {
+        int level = q_index_random_level(idx);
+        if (!level)
+            continue;
+        q_tower_t *t = q_tower_new(idx, level);
+        if (!t) {
+            ok = false;
+            break;
+        }
+        t->entry = entry;
+        for (int i = 0; i < level; i++) {
+            *last[i] = t;
+            last[i] = &t->next[i];
+        }
+        if (level > idx->level)
+            idx->level = level;
+    }
+    for (int i = 0; i < Q_INDEX_MAX_LEVEL; i++)
+        *last[i] = NULL;
+
+    if (!ok)
+        q_index_clear(idx);
+    idx->stale = !ok;
+    return ok;
+}
+
+/* Get the index of the queue, laid out again if it is out of date. NULL if
+ * there is none, or if it could not be laid out.
+ */
+static q_index_t *q_index_get(struct list_head *head)
+{
+    q_index_t *idx = q_head(head)->index;
+    if (idx && idx->stale && !q_index_layout(head, idx))
+        return NULL;
+    return idx;
+}
+
+/* Whether a node holding @value goes before the position searched for @s */
+static inline bool q_index_before(const char *value, const char *s, bool upper)
+{
+    int cmp = q_value_cmp(value, s);
+    return upper ? cmp <= 0 : cmp < 0;
+}
+
+/* Find the first node whose value is not less than @s, or not greater than
+ * @s either if @upper is set. The towers of @idx are used to get close, the
+ * list for the last steps. If @update is not NULL, update[i] receives the
+ * level i + 1 link which points at or past that node.
+ */
+static list_head *q_index_search(struct list_head *head,
+                                 q_index_t *idx,
+                                 const char *s,
+                                 bool upper,
+                                 q_tower_t ***update)
+{
+    list_head *node = head;
+    if (idx) {
+        q_tower_t **links = idx->next;
+        for (int i = idx->level - 1; i >= 0; i--) {
+            q_tower_t *t;
+            while ((t = links[i]) &&
+                   q_index_before(t->entry->value, s, upper)) {
+                links = t->next;
+                node = &t->entry->list;
+            }
+            if (update)
+                update[i] = &links[i];
+        }
+    }
+
+    for (node = node->next; node != head; node = node->next) {
+        if (!q_index_before(list_entry(node, element_t, list)->value, s, upper))
+            break;
+    }
+    return node;
+}
+
+/* Build a skip-list index over a queue sorted in ascending order */
+bool q_index_build(struct list_head *head)
+{
+    if (!head)
+        return false;
+
+    queue_head_t *qh = q_head(head);
+    if (!qh->index) {
+        qh->index = calloc(1, sizeof(q_index_t));
+        if (!qh->index)
+            return false;
+        qh->index->seed = 0x9e3779b97f4a7c15ULL;
+    }
+    return q_index_layout(head, qh->index);
+}
+
+/* Free the index of a queue */
+void q_index_drop(struct list_head *head)
+{
+    if (!head || !q_head(head)->index)
+        return;
+
+    q_index_t *idx = q_head(head)->index;
+    q_index_clear(idx);
+    for (int level = 1; level <= Q_INDEX_MAX_LEVEL; level++) {
+        while (idx->spare[level]) {
+            q_tower_t *t = idx->spare[level];
+            idx->spare[level] = t->next[0];
+            free(t);
+        }
+    }
+    free(idx);
+    q_head(head)->index = NULL;
+}
+
+/* Find the first element not less than a string */
+element_t *q_index_lower_bound(struct list_head *head, const char *s)
+{
+    if (!head)
+        return NULL;
+
+    list_head *node = q_index_search(head, q_index_get(head), s, false, NULL);
+    return node == head ? NULL : list_entry(node, element_t, list);
+}
+
+/* Find the first element equal to a string */
+element_t *q_index_find(struct list_head *head, const char *s)
+{
+    element_t *entry = q_index_lower_bound(head, s);
+    return entry && !strcmp(entry->value, s) ? entry : NULL;
+}
+
+/* Insert an element in order */
+bool q_index_insert(struct list_head *head, char *s)
+{
+    if (!head)
+        return false;
+
+    q_index_t *idx = q_index_get(head);
+    q_tower_t **update[Q_INDEX_MAX_LEVEL];
+    list_head *node = q_index_search(head, idx, s, true, update);
+
+    element_t *entry = q_new_element(q_head(head), s);
+    if (!entry)
+        return false;
+
+    int level = idx ? q_index_random_level(idx) : 0;
+    if (level) {
+        q_tower_t *t = q_tower_new(idx, level);
+        if (!t) {
+            q_release_element(entry);
+            return false;
+        }
+        t->entry = entry;
+        for (int i = idx->level; i < level; i++)
+            update[i] = &idx->next[i];
+        for (int i = 0; i < level; i++) {
+            t->next[i] = *update[i];
+            *update[i] = t;
+        }
+        if (level > idx->level)
+            idx->level = level;
     }
-    list_splice(&dummy, head);
-}
\ No newline at end of file
+
+    /* In front of the first node greater than s */
+    list_add_tail(&entry->list, node);
+    q_head(head)->size++;
+    return true;
+}
+
+/* Delete the first element equal to a string */
+bool q_index_delete(struct list_head *head, const char *s)
+{
+    if (!head)
+        return false;
+
+    q_index_t *idx = q_index_get(head);
+    q_tower_t **update[Q_INDEX_MAX_LEVEL];
+    list_head *node = q_index_search(head, idx, s, false, update);
+    if (node == head || strcmp(list_entry(node, element_t, list)->value, s))
+        return false;
+    element_t *entry = list_entry(node, element_t, list);
+
+    if (idx) {
+        /* A tower of the node comes right after the links found */
+        q_tower_t *gone = NULL;
+        for (int i = 0; i < idx->level; i++) {
+            q_tower_t *t = *update[i];
+            if (!t || t->entry != entry)
+                break;
+            *update[i] = t->next[i];
+            gone = t;
+        }
+        if (gone) {
+            gone->next[0] = idx->spare[gone->level];
+            idx->spare[gone->level] = gone;
+        }
+        while (idx->level && !idx->next[idx->level - 1])
+            idx->level--;
+    }
+
+    list_del(node);
+    q_head(head)->size--;
+    q_release_element(entry);
+    return true;
+}
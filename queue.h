@@ -13,18 +13,58 @@
 #include "harness.h"
 #include "list.h"
 
+/* Strings of up to Q_INLINE_LEN - 1 characters are kept inside the element */
+#define Q_INLINE_LEN 24
+
 /**
  * element_t - Linked list element
  * @value: pointer to array holding string
  * @list: node of a doubly-linked list
+ * @inline_value: storage for short strings, right behind the list links
  *
- * @value needs to be explicitly allocated and freed
+ * @value points to @inline_value when the string fits, otherwise it needs to
+ * be explicitly allocated and freed.
  */
 typedef struct {
     char *value;
     struct list_head list;
+    char inline_value[Q_INLINE_LEN];
 } element_t;
 
+/* Skip-list index over the nodes of a sorted queue, see q_index_build() */
+typedef struct q_index q_index_t;
+
+/**
+ * queue_head_t - Counted head of a queue
+ * @head: head of the circular doubly-linked list, must be the first member
+ * @size: number of elements currently linked on @head
+ * @arena: where new elements are allocated, NULL to use malloc
+ * @mixed: whether @head may hold elements that are not from @arena
+ * @index: ordered index over the elements, NULL if none was built
+ *
+ * q_new() allocates a queue_head_t and hands out a pointer to @head, so the
+ * queue can still be walked with the list.h helpers. Every q_* operation keeps
+ * @size in sync with the list, which makes q_size() O(1).
+ */
+typedef struct {
+    struct list_head head;
+    int size;
+    test_arena_t *arena;
+    bool mixed;
+    q_index_t *index;
+} queue_head_t;
+
+/**
+ * q_head() - Get the counted head of a queue created by q_new()
+ * @head: header of queue
+ *
+ * Return: the queue_head_t embedding @head
+ */
+static inline queue_head_t *q_head(struct list_head *head)
+{
+    return list_entry(head, queue_head_t, head);
+}
+
 /**
  * queue_contex_t - The context managing a chain of queues
  * @q: pointer to the head of the queue
@@ -48,9 +88,25 @@ typedef struct {
  */
 struct list_head *q_new();
 
+/**
+ * q_new_arena() - Create an empty queue whose elements come from an arena
+ *
+ * Elements and strings inserted later are bump allocated from chunks owned by
+ * the queue, and q_free() gives the chunks back without visiting the elements.
+ * An element removed from the queue can be released as usual, but must not be
+ * used once the queue is freed. Queues merged into this one hand their own
+ * arenas over to it.
+ *
+ * Return: NULL for allocation failed
+ */
+struct list_head *q_new_arena();
+
 /**
  * q_free() - Free all storage used by queue, no effect if header is NULL
  * @head: header of queue
+ *
+ * For a queue from q_new_arena() this takes time in the number of chunks
+ * rather than of elements, unless elements allocated elsewhere were merged in.
  */
 void q_free(struct list_head *head);
 
@@ -78,6 +134,33 @@ bool q_insert_head(struct list_head *head, char *s);
  */
 bool q_insert_tail(struct list_head *head, char *s);
 
+/**
+ * q_insert_head_many() - Insert n elements in the head
+ * @head: header of queue
+ * @s: array of strings would be inserted
+ * @n: number of strings in @s
+ *
+ * Same result as calling q_insert_head() for s[0], s[1], ..., s[n-1] in turn,
+ * so s[n-1] ends up first. If an allocation fails, the elements inserted so
+ * far are removed again, so either all of them are inserted or none is.
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool q_insert_head_many(struct list_head *head, char **s, int n);
+
+/**
+ * q_insert_tail_many() - Insert n elements at the tail
+ * @head: header of queue
+ * @s: array of strings would be inserted
+ * @n: number of strings in @s
+ *
+ * Same result as calling q_insert_tail() for s[0], s[1], ..., s[n-1] in turn.
+ * Either all of the elements are inserted or none is.
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool q_insert_tail_many(struct list_head *head, char **s, int n);
+
 /**
  * q_remove_head() - Remove the element from head of queue
  * @head: header of queue
@@ -108,6 +191,44 @@ element_t *q_remove_head(struct list_head *head, char *sp, size_t bufsize);
  */
 element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize);
 
+/**
+ * q_cut_head() - Detach the first n elements of queue
+ * @head: header of queue
+ * @list: plain list head which receives the elements, its former contents are
+ * discarded
+ * @n: number of elements to detach
+ *
+ * The elements are moved with list_cut_position(), so no string is copied.
+ * Finding the cutting point walks from whichever end of the queue is closer.
+ * @list is not a queue created by q_new(): release the elements with
+ * q_release_list() once done with them.
+ *
+ * Return: the number of elements moved, which is less than @n if the queue is
+ * shorter, zero if queue is NULL or empty
+ */
+int q_cut_head(struct list_head *head, struct list_head *list, int n);
+
+/**
+ * q_remove_head_n() - Remove the first n elements of queue as a new queue
+ * @head: header of queue
+ * @n: number of elements to remove
+ *
+ * Same as q_cut_head(), except that the elements are handed over in a queue
+ * of their own, which is released at once with q_free().
+ *
+ * Return: the new queue, %NULL if queue is NULL or allocation failed
+ */
+struct list_head *q_remove_head_n(struct list_head *head, int n);
+
+/**
+ * q_release_list() - Release every element on a list
+ * @list: plain list head, left empty
+ *
+ * This is for the lists filled by q_cut_head(). Queues are released with
+ * q_free().
+ */
+void q_release_list(struct list_head *list);
+
 /**
  * q_release_element() - Release the element
  * @e: element would be released
@@ -116,7 +237,8 @@ element_t *q_remove_tail(struct list_head *head, char *sp, size_t bufsize);
  */
 static inline void q_release_element(element_t *e)
 {
-    test_free(e->value);
+    if (e->value != e->inline_value)
+        test_free(e->value);
     test_free(e);
 }
 
@@ -124,6 +246,8 @@ static inline void q_release_element(element_t *e)
  * q_size() - Get the size of the queue
  * @head: header of queue
  *
+ * The length is read from the counted head in constant time.
+ *
  * Return: the number of elements in queue, zero if queue is NULL or empty
  */
 int q_size(struct list_head *head);
@@ -155,6 +279,22 @@ bool q_delete_mid(struct list_head *head);
  */
 bool q_delete_dup(struct list_head *head);
 
+/**
+ * q_delete_dup_hash() - Delete all nodes that have duplicate string, in a
+ *                       queue which needs not be sorted.
+ * @head: header of queue
+ *
+ * Same result as q_delete_dup() on a sorted queue, and the remaining nodes
+ * keep their order. The strings are looked up in an open-addressing hash set
+ * as the queue is walked once: a later node with a string already seen is
+ * released at once, and the first node with that string once the walk is
+ * done. The set is allocated here and released before returning.
+ *
+ * Return: true for success, false if list is NULL or empty, or if the set
+ * could not be allocated, in which case the queue is left as it was.
+ */
+bool q_delete_dup_hash(struct list_head *head);
+
 /**
  * q_swap() - Swap every two adjacent nodes
  * @head: header of queue
@@ -182,14 +322,31 @@ void q_reverse(struct list_head *head);
  * @k: is a positive integer and is less than or equal to the length of the
  * linked list.
  *
- * No effect if queue is NULL or empty. If there is only one element, do
- * nothing.
+ * The queue is scanned once, reversing each group as it goes. A short final
+ * group is detected at the end of the scan and restored to its order.
+ *
+ * No effect if queue is NULL or empty, or if @k is less than 2. If there is
+ * only one element, do nothing.
  *
  * Reference:
  * https://leetcode.com/problems/reverse-nodes-in-k-group/
  */
 void q_reverseK(struct list_head *head, int k);
 
+/**
+ * q_rotate() - Rotate the queue by k positions
+ * @head: header of queue
+ * @k: number of elements moved from the head to the tail, a negative value
+ * moves elements from the tail to the head instead
+ *
+ * Only the head is relinked, after walking to the k-th node from whichever
+ * end of the queue is closer. @k is taken modulo the queue size.
+ *
+ * No effect if queue is NULL or empty. If there is only one element, do
+ * nothing.
+ */
+void q_rotate(struct list_head *head, int k);
+
 /**
  * q_sort() - Sort elements of queue in ascending/descending order
  * @head: header of queue
@@ -200,6 +357,38 @@ void q_reverseK(struct list_head *head, int k);
  */
 void q_sort(struct list_head *head, bool descend);
 
+/**
+ * q_sort_parallel() - Sort elements of queue on several threads
+ * @head: header of queue
+ * @descend: whether or not to sort in descending order
+ * @nthreads: maximum number of threads to use
+ *
+ * The queue is cut into one contiguous run per thread, the runs are sorted
+ * concurrently with the merge sort behind q_sort(), which leaves the queue
+ * head alone, and then merged pairwise, one level of the merge tree at a time
+ * with the merges of a level running concurrently. The sort is stable. Small
+ * queues, or @nthreads below 2, are sorted by q_sort() directly.
+ *
+ * No effect if queue is NULL or empty. If there is only one element, do
+ * nothing.
+ */
+void q_sort_parallel(struct list_head *head, bool descend, int nthreads);
+
+/**
+ * q_sort_key() - Sort elements of queue through an array of key prefixes
+ * @head: header of queue
+ * @descend: whether or not to sort in descending order
+ *
+ * Same result as q_sort(), stability included. The nodes are gathered into
+ * an array of (8-byte key prefix, node) pairs which is merge sorted and then
+ * relinked, so strcmp() is only reached when two prefixes tie. The array is
+ * allocated here; if that fails, it falls back to q_sort().
+ *
+ * No effect if queue is NULL or empty. If there is only one element, do
+ * nothing.
+ */
+void q_sort_key(struct list_head *head, bool descend);
+
 /**
  * q_ascend() - Delete every node which has a node with a strictly less
  * value anywhere to the right side of it.
@@ -230,6 +419,35 @@ int q_ascend(struct list_head *head);
  */
 int q_descend(struct list_head *head);
 
+/**
+ * q_ascend_cut() - Detach every node which has a node with a strictly less
+ * value anywhere to the right side of it.
+ * @head: header of queue
+ * @list: plain list head which receives the nodes in queue order, its former
+ * contents are discarded
+ *
+ * Same as q_ascend(), but the nodes are handed over instead of released, so
+ * that they can be reused. Release them with q_release_list() once done.
+ * Both functions walk the queue once from the tail, keeping track of the
+ * least value seen so far, and allocate nothing.
+ *
+ * Return: the number of elements in queue after performing operation
+ */
+int q_ascend_cut(struct list_head *head, struct list_head *list);
+
+/**
+ * q_descend_cut() - Detach every node which has a node with a strictly
+ * greater value anywhere to the right side of it.
+ * @head: header of queue
+ * @list: plain list head which receives the nodes in queue order, its former
+ * contents are discarded
+ *
+ * Same as q_descend(), but the nodes are handed over instead of released.
+ *
+ * Return: the number of elements in queue after performing operation
+ */
+int q_descend_cut(struct list_head *head, struct list_head *list);
+
 /**
  * q_merge() - Merge all the queues into one sorted queue, which is in
  * ascending/descending order.
@@ -243,6 +461,11 @@ int q_descend(struct list_head *head);
  * member 'q' since they will be released externally. However, q_merge() is
  * responsible for making the queues to be NULL-queue, except the first one.
  *
+ * The queues are merged at once through a min-heap of their head nodes, which
+ * costs O(N log k) for N elements in k queues. Equal strings are taken from
+ * the earlier queue first, so the merge is stable. Chains too long for the
+ * heap are merged by q_merge_pairwise() instead.
+ *
  * Reference:
  * https://leetcode.com/problems/merge-k-sorted-lists/
  *
@@ -250,19 +473,113 @@ int q_descend(struct list_head *head);
  */
 int q_merge(struct list_head *head, bool descend);
 
+/**
+ * q_merge_pairwise() - Merge all the queues into one sorted queue by merging
+ * neighbouring queues in rounds.
+ * @head: header of chain
+ * @descend: whether to merge queues sorted in descending order
+ *
+ * Same contract as q_merge(), but each round merges queue i + step into queue
+ * i for every i that is a multiple of 2 * step, doubling step until a single
+ * queue is left. This is also O(N log k) and stable.
+ *
+ * Return: the number of elements in queue after merging
+ */
+int q_merge_pairwise(struct list_head *head, bool descend);
+
 /**
  * q_shuffle() - Shuffle the queue.
  *
- * This function randomly shuffles the list by moving nodes to a temporary list,
- * and then reattaching them. It should only be invoked by 'do_shuffle'.
+ * This function takes a snapshot of the node pointers in an array, runs the
+ * Fisher-Yates shuffle on it and relinks the nodes in a single pass, which
+ * is O(n). If the array cannot be allocated, it falls back to
+ * q_shuffle_merge(). It should only be invoked by 'do_shuffle'.
  * The function returns immediately if the list is NULL, empty,
  * or cotains a single node.
  *
  * PRNG function will be called in this functin. The default one is
- * 'randombytes'.
+ * 'randombytes'. Random numbers are requested in batches.
  *
  * @head: header of queue
  */
 void q_shuffle(struct list_head *head);
 
+/**
+ * q_shuffle_merge() - Shuffle the queue without extra memory.
+ * @head: header of queue
+ *
+ * The list is cut into blocks of 1024 nodes, each shuffled with Fisher-Yates
+ * in a fixed-size array. Working bottom-up like q_sort(), runs of equal length
+ * are then interleaved at random, weighted by their remaining lengths, and the
+ * leftover runs are interleaved last. This is O(n log n) but needs no
+ * allocation. Every permutation is equally likely.
+ */
+void q_shuffle_merge(struct list_head *head);
+
+/**
+ * q_index_build() - Build a skip-list index over a queue sorted in ascending
+ * order
+ * @head: header of queue
+ *
+ * The list itself is the bottom level of the skip list. About one node in
+ * four also gets a tower of links to nodes further on, so that the
+ * q_index_*() functions below take O(log n) expected time.
+ *
+ * Any other q_*() operation which changes the queue only marks the index as
+ * out of date, without allocating or freeing anything. The index is rebuilt
+ * in O(n) by the next q_index_*() call, so it stays consistent through
+ * q_sort(), q_delete_dup(), q_merge() and the others, as long as the queue is
+ * sorted in ascending order again by then. On a queue which is not, the
+ * q_index_*() functions do not crash but their results are meaningless.
+ *
+ * Return: true for success, false if queue is NULL or allocation failed, in
+ * which case the q_index_*() functions fall back to linear scans
+ */
+bool q_index_build(struct list_head *head);
+
+/**
+ * q_index_drop() - Free the index of a queue, no effect if it has none
+ * @head: header of queue
+ */
+void q_index_drop(struct list_head *head);
+
+/**
+ * q_index_lower_bound() - Find the first element not less than a string
+ * @head: header of queue, sorted in ascending order
+ * @s: string to look for
+ *
+ * Return: the element, %NULL if queue is NULL or every element is less than @s
+ */
+element_t *q_index_lower_bound(struct list_head *head, const char *s);
+
+/**
+ * q_index_find() - Find the first element equal to a string
+ * @head: header of queue, sorted in ascending order
+ * @s: string to look for
+ *
+ * Return: the element, %NULL if queue is NULL or @s is not in queue
+ */
+element_t *q_index_find(struct list_head *head, const char *s);
+
+/**
+ * q_index_insert() - Insert an element in order
+ * @head: header of queue, sorted in ascending order
+ * @s: string would be inserted
+ *
+ * The element goes after any element equal to @s, so inserting keeps the
+ * queue sorted and stable.
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool q_index_insert(struct list_head *head, char *s);
+
+/**
+ * q_index_delete() - Delete the first element equal to a string
+ * @head: header of queue, sorted in ascending order
+ * @s: string would be deleted
+ *
+ * Return: true for success, false if queue is NULL or @s is not in queue
+ */
+bool q_index_delete(struct list_head *head, const char *s);
+
 #endif /* LAB0_QUEUE_H */
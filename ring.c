@@ -0,0 +1,132 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "ring.h"
+
+/* The two sides of the ring are kept on separate cache lines */
+#define CACHE_LINE 64
+
+typedef struct {
+    char value[RING_VALUE_LEN];
+} ring_slot_t;
+
+struct ring {
+    /* Read-only once the ring is created */
+    ring_slot_t *slots;
+    size_t mask;
+    void *block; /* What was allocated, the ring itself is aligned in it */
+
+    /* Written by the producer only */
+    _Alignas(CACHE_LINE) atomic_size_t tail;
+    size_t head_cache; /* Last head seen by the producer */
+
+    /* Written by the consumer only */
+    _Alignas(CACHE_LINE) atomic_size_t head;
+    size_t tail_cache; /* Last tail seen by the consumer */
+};
+
+/* Create an empty ring */
+ring_t *ring_new(size_t capacity)
+{
+    if (!capacity || capacity > (SIZE_MAX / 2 - sizeof(ring_t) - CACHE_LINE) /
+                                    sizeof(ring_slot_t))
+        return NULL;
+
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    /* The slots follow the ring, which is cache line aligned, and so is its
+     * size.
+     */
+    void *block =
+        malloc(CACHE_LINE - 1 + sizeof(ring_t) + sizeof(ring_slot_t) * size);
+    if (!block)
+        return NULL;
+    ring_t *r = (ring_t *) (((uintptr_t) block + CACHE_LINE - 1) &
+                            ~(uintptr_t) (CACHE_LINE - 1));
+
+    r->slots = (ring_slot_t *) (r + 1);
+    r->mask = size - 1;
+    r->block = block;
+    atomic_init(&r->tail, 0);
+    r->head_cache = 0;
+    atomic_init(&r->head, 0);
+    r->tail_cache = 0;
+    return r;
+}
+
+/* Free all storage used by the ring */
+void ring_free(ring_t *r)
+{
+    if (r)
+        free(r->block);
+}
+
+/* Get the number of strings in the ring */
+size_t ring_size(ring_t *r)
+{
+    if (!r)
+        return 0;
+    return atomic_load_explicit(&r->tail, memory_order_acquire) -
+           atomic_load_explicit(&r->head, memory_order_acquire);
+}
+
+/* Copy strings to the tail of the ring */
+size_t ring_insert_tail_batch(ring_t *r, char **s, size_t n)
+{
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    size_t room = r->mask + 1 - (tail - r->head_cache);
+
+    /* Only look at the consumer's index when the cached one is not enough */
+    if (room < n) {
+        r->head_cache = atomic_load_explicit(&r->head, memory_order_acquire);
+        room = r->mask + 1 - (tail - r->head_cache);
+    }
+    if (n > room)
+        n = room;
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+        size_t len = strnlen(s[i], RING_VALUE_LEN);
+        if (len == RING_VALUE_LEN)
+            break;
+        memcpy(r->slots[(tail + i) & r->mask].value, s[i], len + 1);
+    }
+
+    if (i)
+        atomic_store_explicit(&r->tail, tail + i, memory_order_release);
+    return i;
+}
+
+/* Remove strings from the head of the ring */
+size_t ring_remove_head_batch(ring_t *r, char **sp, size_t n, size_t bufsize)
+{
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    size_t avail = r->tail_cache - head;
+
+    /* Only look at the producer's index when the cached one is not enough */
+    if (avail < n) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        avail = r->tail_cache - head;
+    }
+    if (n > avail)
+        n = avail;
+    if (!n)
+        return 0;
+
+    if (sp && bufsize) {
+        for (size_t i = 0; i < n; i++) {
+            const char *value = r->slots[(head + i) & r->mask].value;
+            size_t len = strnlen(value, bufsize - 1);
+            memcpy(sp[i], value, len);
+            sp[i][len] = '\0';
+        }
+    }
+
+    atomic_store_explicit(&r->head, head + n, memory_order_release);
+    return n;
+}
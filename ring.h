@@ -0,0 +1,101 @@
+#ifndef LAB0_RING_H
+#define LAB0_RING_H
+
+/* This program implements a bounded queue of strings for exactly one producer
+ * thread and one consumer thread.
+ *
+ * Strings are copied into a ring of fixed-size slots, so moving a string
+ * through the queue never allocates. Each side owns one index and publishes
+ * it once per batch.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Strings of up to RING_VALUE_LEN - 1 characters fit in a slot */
+#define RING_VALUE_LEN 64
+
+typedef struct ring ring_t;
+
+/**
+ * ring_new() - Create an empty ring
+ * @capacity: number of strings the ring can hold, rounded up to a power of 2
+ *
+ * Return: NULL for allocation failed or zero capacity
+ */
+ring_t *ring_new(size_t capacity);
+
+/**
+ * ring_free() - Free all storage used by the ring, no effect if @r is NULL
+ * @r: ring
+ */
+void ring_free(ring_t *r);
+
+/**
+ * ring_size() - Get the number of strings in the ring
+ * @r: ring
+ *
+ * Only exact when neither side is running concurrently.
+ *
+ * Return: the number of strings in the ring, zero if @r is NULL
+ */
+size_t ring_size(ring_t *r);
+
+/**
+ * ring_insert_tail_batch() - Copy strings to the tail of the ring
+ * @r: ring
+ * @s: array of strings to insert, in order
+ * @n: number of strings in @s
+ *
+ * Must only be called by the producer. The strings are copied into free slots
+ * and all of them are published to the consumer with a single index update.
+ * Insertion stops early when the ring is full, or at the first string longer
+ * than RING_VALUE_LEN - 1 characters. The time taken does not depend on how
+ * full the ring is.
+ *
+ * Return: the number of strings inserted, which are s[0] to s[ret - 1]
+ */
+size_t ring_insert_tail_batch(ring_t *r, char **s, size_t n);
+
+/**
+ * ring_remove_head_batch() - Remove strings from the head of the ring
+ * @r: ring
+ * @sp: array of @n output buffers, or NULL to discard the strings
+ * @n: maximum number of strings to remove
+ * @bufsize: size of each buffer in @sp
+ *
+ * Must only be called by the consumer. Like q_remove_head(), each removed
+ * string is copied to sp[i] (up to a maximum of bufsize-1 characters, plus a
+ * null terminator). The slots are handed back to the producer with a single
+ * index update.
+ *
+ * Return: the number of strings removed, zero if the ring is empty
+ */
+size_t ring_remove_head_batch(ring_t *r, char **sp, size_t n, size_t bufsize);
+
+/**
+ * ring_insert_tail() - Copy a single string to the tail of the ring
+ * @r: ring
+ * @s: string to insert
+ *
+ * Return: true for success, false if the ring is full or @s is too long
+ */
+static inline bool ring_insert_tail(ring_t *r, char *s)
+{
+    return ring_insert_tail_batch(r, &s, 1);
+}
+
+/**
+ * ring_remove_head() - Remove a single string from the head of the ring
+ * @r: ring
+ * @sp: output buffer where the removed string is copied, or NULL
+ * @bufsize: size of @sp
+ *
+ * Return: true for success, false if the ring is empty
+ */
+static inline bool ring_remove_head(ring_t *r, char *sp, size_t bufsize)
+{
+    return ring_remove_head_batch(r, sp ? &sp : NULL, 1, bufsize);
+}
+
+#endif /* LAB0_RING_H */
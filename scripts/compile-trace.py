@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+
+# Compile a qtest command file into the binary trace format read by btrace.c,
+# so that 'replay FILE' runs it without parsing each line again.
+#
+# Queue commands in their usual forms become opcodes of their own, and any
+# other line becomes a generic command op which qtest hands to its console.
+# Files named by 'source' are compiled in place, and nothing after 'quit' is
+# kept. While simulation mode is on, every command is kept generic. Replayed
+# commands are not echoed.
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+MAGIC = b"QTRB"
+VERSION = 1
+
+(BT_CMD, BT_IH, BT_IT, BT_RH, BT_RT, BT_SIZE, BT_REVERSE, BT_SWAP, BT_SORT,
+ BT_DM, BT_REVERSEK) = range(11)
+
+NO_ARGS = {
+    b"size": BT_SIZE,
+    b"reverse": BT_REVERSE,
+    b"swap": BT_SWAP,
+    b"sort": BT_SORT,
+    b"dm": BT_DM,
+}
+
+INT_MAX = 2**31 - 1
+# Same as RIO_BUFSIZE - 2 in console.c, past which a line is cut
+MAX_LINE = 8190
+
+# Only counts get_int would read the same way, whatever its base
+COUNT = re.compile(rb"[1-9][0-9]*\Z")
+
+
+def varint(n):
+    out = bytearray()
+    while True:
+        b = n & 0x7f
+        n >>= 7
+        if n:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def integer(word):
+    """Read a number as get_int does, None if it is not one"""
+    try:
+        return int(word, 0)
+    except ValueError:
+        return None
+
+
+def count(word):
+    if not COUNT.match(word):
+        return None
+    n = int(word)
+    return n if n <= INT_MAX else None
+
+
+class Compiler:
+
+    def __init__(self):
+        self.strings = {}
+        self.ops = bytearray()
+        self.nr_ops = 0
+        self.simulation = False
+        self.quit = False
+
+    def ref(self, s):
+        return varint(self.strings.setdefault(s, len(self.strings)))
+
+    def optional_ref(self, s):
+        if s is None:
+            return varint(0)
+        return varint(self.strings.setdefault(s, len(self.strings)) + 1)
+
+    def emit(self, code, operands=b""):
+        self.ops.append(code)
+        self.ops += operands
+        self.nr_ops += 1
+
+    def command(self, argv):
+        name, args = argv[0], argv[1:]
+        if name == b"option":
+            for i in range(0, len(args) - 1, 2):
+                value = integer(args[i + 1])
+                if args[i] == b"simulation" and value is not None:
+                    self.simulation = value != 0
+
+        if self.simulation:
+            pass
+        elif name in (b"ih", b"it") and len(args) in (1, 2):
+            n = count(args[1]) if len(args) == 2 else 1
+            if n is not None:
+                s = None if args[0] == b"RAND" else args[0]
+                code = BT_IH if name == b"ih" else BT_IT
+                return self.emit(code, self.optional_ref(s) + varint(n))
+        elif name in (b"rh", b"rt") and len(args) <= 1:
+            code = BT_RH if name == b"rh" else BT_RT
+            return self.emit(code,
+                             self.optional_ref(args[0] if args else None))
+        elif name in NO_ARGS and not args:
+            return self.emit(NO_ARGS[name])
+        elif name == b"reverseK" and len(args) == 1:
+            k = count(args[0])
+            if k is not None:
+                return self.emit(BT_REVERSEK, varint(k))
+
+        self.emit(BT_CMD,
+                  varint(len(argv)) + b"".join(self.ref(a) for a in argv))
+        self.quit = name == b"quit"
+
+    def compile(self, path):
+        with open(path, "rb") as f:
+            data = f.read()
+
+        for line in data.split(b"\n"):
+            # Longer lines are read as several ones, each up to a null byte
+            for i in range(0, max(len(line), 1), MAX_LINE):
+                if self.quit:
+                    return
+                argv = line[i:i + MAX_LINE].split(b"\0", 1)[0].split()
+                if not argv:
+                    continue
+                # A file that cannot be read is left for qtest to report
+                if argv[0] == b"source" and len(argv) >= 2 and \
+                        os.access(argv[1], os.R_OK):
+                    self.compile(argv[1])
+                    continue
+                self.command(argv)
+
+    def write(self, f):
+        table = bytearray()
+        for s in sorted(self.strings, key=self.strings.get):
+            table += varint(len(s)) + s + b"\0"
+        f.write(MAGIC + struct.pack("<III", VERSION, len(self.strings), 0) +
+                struct.pack("<Q", self.nr_ops))
+        f.write(table)
+        f.write(self.ops)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Compile a qtest command file for 'replay'")
+    parser.add_argument("input", help="command file, such as a .cmd trace")
+    parser.add_argument("-o", "--output",
+                        help="compiled trace (default: input with .bin)")
+    args = parser.parse_args()
+
+    output = args.output or re.sub(r"(\.cmd)?$", ".bin", args.input, count=1)
+    compiler = Compiler()
+    try:
+        compiler.compile(args.input)
+    except OSError as e:
+        sys.exit(f"{e.filename}: {e.strerror}")
+    with open(output, "wb") as f:
+        compiler.write(f)
+    print(f"{output}: {compiler.nr_ops} operations, "
+          f"{len(compiler.strings)} strings")
+
+
+if __name__ == "__main__":
+    main()
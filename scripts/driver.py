@@ -1,9 +1,15 @@
 #!/usr/bin/env python3
 
 from __future__ import print_function
+import concurrent.futures
+import getopt
+import json
+import os
+import shutil
 import subprocess
 import sys
-import getopt
+import tempfile
+import time
 
 
 
@@ -60,6 +66,13 @@ class Tracer:
 
     maxScores = [0, 5, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 5]
 
+    # Traces whose verdict depends on timing measurements, which are only run
+    # once no other trace is running
+    exclusiveTraces = {17}
+
+    # Wall and command times below this many seconds are too short to compare
+    minCompareTime = 0.05
+
     RED = '\033[91m'
     GREEN = '\033[92m'
     WHITE = '\033[0m'
@@ -69,33 +82,148 @@ class Tracer:
                  verbLevel=0,
                  autograde=False,
                  useValgrind=False,
-                 colored=False):
+                 colored=False,
+                 jobs=1,
+                 logDir=None,
+                 jsonFile=None,
+                 baselineFile=None,
+                 threshold=20.0):
         if qtest != "":
             self.qtest = qtest
         self.verbLevel = verbLevel
         self.autograde = autograde
         self.useValgrind = useValgrind
         self.colored = colored
+        self.jobs = max(jobs, 1)
+        self.logDir = logDir
+        self.jsonFile = jsonFile
+        self.baselineFile = baselineFile
+        self.threshold = threshold
 
     def printInColor(self, text, color):
         if self.colored == False:
             color = self.WHITE
         print(color, text, self.WHITE, sep = '')
 
-    def runTrace(self, tid):
-        if not tid in self.traceDict:
-            self.printInColor("ERROR: No trace with id %d" % tid, self.RED)
-            return False
-        fname = "%s/%s.cmd" % (self.traceDirectory, self.traceDict[tid])
+    def runTrace(self, tid, logDir):
+        """Run a trace with its output, log and command times kept in logDir.
+
+        Return a dictionary with the outcome, wall time in seconds, peak RSS in
+        KiB and time spent in each command. The peak RSS counts the pages the
+        child inherited from the driver, so it is never below the footprint of
+        the driver itself.
+        """
+        tname = self.traceDict[tid]
+        fname = "%s/%s.cmd" % (self.traceDirectory, tname)
         vname = "%d" % self.verbLevel
-        clist = self.command + ["-v", vname, "-f", fname]
+        base = os.path.join(logDir, tname)
+        clist = self.command + ["-v", vname, "-f", fname,
+                                "-l", base + ".log", "-t", base + ".times"]
+        result = {"id": tid, "ok": False, "wall": 0.0, "maxrss": 0,
+                  "commands": {}, "error": None}
 
         try:
-            retcode = subprocess.call(clist)
+            with open(base + ".out", "wb") as out:
+                start = time.monotonic()
+                proc = subprocess.Popen(clist, stdout=out,
+                                        stderr=subprocess.STDOUT)
+                _, status, usage = os.wait4(proc.pid, 0)
+                result["wall"] = time.monotonic() - start
         except Exception as e:
-            self.printInColor("Call of '%s' failed: %s" % (" ".join(clist), e), self.RED)
-            return False
-        return retcode == 0
+            result["error"] = "Call of '%s' failed: %s" % (" ".join(clist), e)
+            return result
+        # The child is reaped already, so tell Popen not to wait for it
+        proc.returncode = 0
+        result["ok"] = os.WIFEXITED(status) and os.WEXITSTATUS(status) == 0
+        result["maxrss"] = usage.ru_maxrss
+
+        try:
+            with open(base + ".times") as f:
+                for line in f:
+                    name, _, secs = line.rstrip("\n").rpartition("\t")
+                    stats = result["commands"].setdefault(
+                        name, {"count": 0, "total": 0.0, "max": 0.0})
+                    stats["count"] += 1
+                    stats["total"] += float(secs)
+                    stats["max"] = max(stats["max"], float(secs))
+        except (OSError, ValueError):
+            pass
+        return result
+
+    def showTrace(self, result, logDir):
+        tname = self.traceDict[result["id"]]
+        if self.verbLevel > 0:
+            print("+++ TESTING trace %s:" % tname)
+        sys.stdout.flush()
+        try:
+            with open(os.path.join(logDir, tname + ".out"), "rb") as f:
+                shutil.copyfileobj(f, sys.stdout.buffer)
+        except OSError:
+            pass
+        sys.stdout.flush()
+        if result["error"]:
+            self.printInColor("ERROR: " + result["error"], self.RED)
+
+    def compare(self, results):
+        """Flag the traces that got slower, overall or in any command, or
+        larger than in the baseline.
+
+        Return the number of regressions.
+        """
+        try:
+            with open(self.baselineFile) as f:
+                baseline = json.load(f)["traces"]
+        except (OSError, ValueError, KeyError) as e:
+            self.printInColor("ERROR: Cannot read baseline '%s': %s" %
+                              (self.baselineFile, e), self.RED)
+            return 1
+
+        limit = 1 + self.threshold / 100
+        regressions = 0
+        for t in sorted(results):
+            tname = self.traceDict[t]
+            old, new = baseline.get(tname), results[t]
+            if not old or not old["ok"] or not new["ok"]:
+                continue
+            times = [("wall time", old["wall"], new["wall"])]
+            oldCommands = old.get("commands", {})
+            for name in sorted(new["commands"]):
+                if name in oldCommands:
+                    times.append(("time in '%s'" % name,
+                                  oldCommands[name]["total"],
+                                  new["commands"][name]["total"]))
+            # Times too short to compare are left out
+            checks = [(what, before, after, "%.3fs")
+                      for what, before, after in times
+                      if max(before, after) >= self.minCompareTime]
+            checks.append(("peak RSS", old["maxrss"], new["maxrss"], "%dKiB"))
+            for what, before, after, fmt in checks:
+                if before > 0 and after > before * limit:
+                    self.printInColor(
+                        ("+++ REGRESSION %s: %s " + fmt + " -> " + fmt +
+                         " (+%.0f%%)") % (tname, what, before, after,
+                                          (after / before - 1) * 100),
+                        self.RED)
+                    regressions += 1
+        return regressions
+
+    def writeJson(self, results, scoreDict):
+        traces = {}
+        for t in sorted(results):
+            r = results[t]
+            traces[self.traceDict[t]] = {
+                "id": t,
+                "ok": r["ok"],
+                "score": scoreDict[t],
+                "wall": r["wall"],
+                "maxrss": r["maxrss"],
+                "commands": r["commands"],
+            }
+        with open(self.jsonFile, "w") as f:
+            json.dump({"score": sum(scoreDict.values()),
+                       "maxscore": sum(self.maxScores[t] for t in results),
+                       "traces": traces}, f, indent=2, sort_keys=True)
+            f.write("\n")
 
     def run(self, tid=0):
         scoreDict = {k: 0 for k in self.traceDict.keys()}
@@ -113,20 +241,41 @@ class Tracer:
             self.command = ['valgrind', self.qtest]
         else:
             self.command = [self.qtest]
-        for t in tidList:
-            tname = self.traceDict[t]
-            if self.verbLevel > 0:
-                print("+++ TESTING trace %s:" % tname)
-            ok = self.runTrace(t)
-            maxval = self.maxScores[t]
-            tval = maxval if ok else 0
-            if tval < maxval:
-                self.printInColor("---\t%s\t%d/%d" % (tname, tval, maxval), self.RED)
-            else:
-                self.printInColor("---\t%s\t%d/%d" % (tname, tval, maxval), self.GREEN)
-            score += tval
-            maxscore += maxval
-            scoreDict[t] = tval
+
+        # Each trace writes its own files, so that concurrent runs do not mix
+        # their output. Results are shown in trace order as they come in.
+        if self.logDir:
+            os.makedirs(self.logDir, exist_ok=True)
+            logDir = self.logDir
+        else:
+            logDir = tempfile.mkdtemp(prefix="driver-")
+        results = {}
+        pool = concurrent.futures.ThreadPoolExecutor(self.jobs)
+        try:
+            futures = {t: pool.submit(self.runTrace, t, logDir)
+                       for t in tidList if t not in self.exclusiveTraces}
+            for t in tidList:
+                if t in futures:
+                    results[t] = futures[t].result()
+                else:
+                    concurrent.futures.wait(futures.values())
+                    results[t] = self.runTrace(t, logDir)
+                self.showTrace(results[t], logDir)
+
+                tname = self.traceDict[t]
+                maxval = self.maxScores[t]
+                tval = maxval if results[t]["ok"] else 0
+                if tval < maxval:
+                    self.printInColor("---\t%s\t%d/%d" % (tname, tval, maxval), self.RED)
+                else:
+                    self.printInColor("---\t%s\t%d/%d" % (tname, tval, maxval), self.GREEN)
+                score += tval
+                maxscore += maxval
+                scoreDict[t] = tval
+        finally:
+            pool.shutdown()
+            if not self.logDir:
+                shutil.rmtree(logDir, ignore_errors=True)
         if score < maxscore:
             self.printInColor("---\tTOTAL\t\t%d/%d" % (score, maxscore), self.RED)
         else:
@@ -142,16 +291,30 @@ class Tracer:
                 jstring += '"%s" : %d' % (self.traceProbs[k], scoreDict[k])
             jstring += '}}'
             print(jstring)
-        if score < maxscore:
+        if self.jsonFile:
+            self.writeJson(results, scoreDict)
+        regressions = self.compare(results) if self.baselineFile else 0
+        if score < maxscore or regressions:
             sys.exit(1)
 
 def usage(name):
-    print("Usage: %s [-h] [-p PROG] [-t TID] [-v LEVEL] [--valgrind] [-c]" % name)
+    print("Usage: %s [-h] [-p PROG] [-t TID] [-v LEVEL] [--valgrind] [-c] "
+          "[-j JOBS]" % name)
+    print("       [--log-dir DIR] [--json FILE] [--baseline FILE] "
+          "[--threshold PCT]")
     print("  -h        Print this message")
     print("  -p PROG   Program to test")
     print("  -t TID    Trace ID to test")
     print("  -v LEVEL  Set verbosity level (0-3)")
     print("  -c Enable colored text")
+    print("  -j JOBS   Run up to JOBS traces at once (default 1)")
+    print("  --log-dir DIR    Keep the output, log and command times of each "
+          "trace in DIR")
+    print("  --json FILE      Write scores, wall times, peak RSS and command "
+          "times to FILE")
+    print("  --baseline FILE  Flag traces slower or larger than in FILE, as "
+          "written by --json")
+    print("  --threshold PCT  Allowed growth over the baseline (default 20)")
     sys.exit(0)
 
 
@@ -163,8 +326,15 @@ def run(name, args):
     autograde = False
     useValgrind = False
     colored = False
+    jobs = 1
+    logDir = None
+    jsonFile = None
+    baselineFile = None
+    threshold = 20.0
 
-    optlist, args = getopt.getopt(args, 'hp:t:v:A:c', ['valgrind'])
+    optlist, args = getopt.getopt(
+        args, 'hp:t:v:A:cj:',
+        ['valgrind', 'log-dir=', 'json=', 'baseline=', 'threshold='])
     for (opt, val) in optlist:
         if opt == '-h':
             usage(name)
@@ -181,6 +351,16 @@ def run(name, args):
             useValgrind = True
         elif opt == '-c':
             colored = True
+        elif opt == '-j':
+            jobs = int(val)
+        elif opt == '--log-dir':
+            logDir = val
+        elif opt == '--json':
+            jsonFile = val
+        elif opt == '--baseline':
+            baselineFile = val
+        elif opt == '--threshold':
+            threshold = float(val)
         else:
             print("Unrecognized option '%s'" % opt)
             usage(name)
@@ -190,7 +370,12 @@ def run(name, args):
                verbLevel=vlevel,
                autograde=autograde,
                useValgrind=useValgrind,
-               colored=colored)
+               colored=colored,
+               jobs=jobs,
+               logDir=logDir,
+               jsonFile=jsonFile,
+               baselineFile=baselineFile,
+               threshold=threshold)
     t.run(tid)
 
 
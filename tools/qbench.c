@@ -0,0 +1,975 @@
+/* Micro-benchmark driver for the queue operations declared in queue.h
+ *
+ * Every operation is run over a set of queue sizes and key distributions.
+ * The queue is prepared outside of the timed region, then the operation is
+ * timed and, where the kernel allows it, the CPU cycles, instructions, cache
+ * misses and branch misses it caused are counted with perf_event_open().
+ * Results go to stdout as a table, CSV or JSON.
+ *
+ * The queue.h implementation is measured by default. Building with
+ * "make qbench UNROLLED=1" measures the unrolled list of uqueue.h instead, on
+ * the operations both provide.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/* Our program needs to use regular malloc/free */
+#define INTERNAL 1
+#include "harness.h"
+
+#include "keygen.h"
+#include "pqueue.h"
+#include "queue.h"
+#ifdef QBENCH_UNROLLED
+#include "uqueue.h"
+#endif
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+/* Backend under test */
+#ifdef QBENCH_UNROLLED
+#define BACKEND "unrolled"
+typedef uqueue_t bq_t;
+#define bq_new uq_new
+#define bq_free uq_free
+#define bq_insert_head uq_insert_head
+#define bq_insert_tail uq_insert_tail
+#define bq_size uq_size
+#define bq_delete_mid uq_delete_mid
+#define bq_delete_dup uq_delete_dup
+#define bq_sort uq_sort
+#else
+#define BACKEND "list"
+typedef struct list_head bq_t;
+#define bq_new q_new
+#define bq_free q_free
+#define bq_insert_head q_insert_head
+#define bq_insert_tail q_insert_tail
+#define bq_size q_size
+#define bq_delete_mid q_delete_mid
+#define bq_delete_dup q_delete_dup
+#define bq_sort q_sort
+#endif
+
+/* Buffer handed to q_remove_head/q_remove_tail */
+#define REMOVE_BUFSIZE 64
+
+/* Elements detached by every q_cut_head call */
+#define CUT_BATCH 64
+
+/* q_delete_mid walks half the queue, so only this many calls are timed */
+#define DELETE_MID_CALLS 100
+
+#define MAX_REPEATS 101
+
+/* Hardware events sampled around every timed region */
+enum {
+    EV_CYCLES,
+    EV_INSTRUCTIONS,
+    EV_CACHE_MISSES,
+    EV_BRANCH_MISSES,
+    NR_EVENTS,
+};
+
+static const char *event_names[NR_EVENTS] = {
+    "cycles",
+    "instructions",
+    "cache_misses",
+    "branch_misses",
+};
+
+typedef struct {
+    int fd[NR_EVENTS]; /* -1 when the event could not be opened */
+    bool avail;        /* At least the group leader is counting */
+} counters_t;
+
+typedef struct {
+    double ns;
+    uint64_t count[NR_EVENTS];
+    bool valid[NR_EVENTS];
+} sample_t;
+
+/* State shared by a single benchmark run */
+typedef struct {
+    char **keys; /* Keys in insertion order for the current distribution */
+    int n;
+    counters_t *ctr;
+    struct timespec start;
+    sample_t *sample;
+} bench_ctx_t;
+
+/* Prepare the input, call bench_start and bench_stop around the timed code,
+ * clean up, and return the number of operations the timed code performed.
+ * Whole-queue operations count one operation per element.
+ */
+typedef size_t (*bench_func_t)(bench_ctx_t *ctx);
+
+typedef struct {
+    const char *name;
+    bench_func_t func;
+} bench_t;
+
+enum { FMT_TEXT, FMT_CSV, FMT_JSON };
+
+/* Settable parameters */
+
+static int reverse_k = 4;
+static int merge_queues = 8;
+static int sort_threads = 4;
+static int repeats = 5;
+static int format = FMT_TEXT;
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+
+/* Hardware counters */
+
+#ifdef __linux__
+static int perf_open(uint64_t config, int group)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = config;
+    attr.disabled = group < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+static void counters_init(counters_t *ctr)
+{
+    for (int i = 0; i < NR_EVENTS; i++)
+        ctr->fd[i] = -1;
+    ctr->avail = false;
+
+#ifdef __linux__
+    static const uint64_t config[NR_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    ctr->fd[0] = perf_open(config[0], -1);
+    if (ctr->fd[0] < 0) {
+        fprintf(stderr,
+                "qbench: hardware counters unavailable (%s), timing only\n",
+                strerror(errno));
+        return;
+    }
+    ctr->avail = true;
+    /* Events the PMU does not support are simply left out of the group */
+    for (int i = 1; i < NR_EVENTS; i++)
+        ctr->fd[i] = perf_open(config[i], ctr->fd[0]);
+#endif
+}
+
+static void counters_free(counters_t *ctr)
+{
+    for (int i = 0; i < NR_EVENTS; i++) {
+        if (ctr->fd[i] >= 0)
+            close(ctr->fd[i]);
+    }
+}
+
+static void counters_start(counters_t *ctr)
+{
+#ifdef __linux__
+    if (!ctr->avail)
+        return;
+    ioctl(ctr->fd[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(ctr->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+static void counters_stop(counters_t *ctr, sample_t *s)
+{
+    for (int i = 0; i < NR_EVENTS; i++)
+        s->valid[i] = false;
+
+#ifdef __linux__
+    if (!ctr->avail)
+        return;
+    ioctl(ctr->fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    /* Group read: nr, then one { value, id } pair per opened event */
+    uint64_t buf[1 + 2 * NR_EVENTS];
+    if (read(ctr->fd[0], buf, sizeof(buf)) < (ssize_t) sizeof(uint64_t))
+        return;
+
+    for (int i = 0; i < NR_EVENTS; i++) {
+        uint64_t id;
+        if (ctr->fd[i] < 0 || ioctl(ctr->fd[i], PERF_EVENT_IOC_ID, &id) < 0)
+            continue;
+        for (uint64_t j = 0; j < buf[0] && j < NR_EVENTS; j++) {
+            if (buf[2 + 2 * j] == id) {
+                s->count[i] = buf[1 + 2 * j];
+                s->valid[i] = true;
+                break;
+            }
+        }
+    }
+#endif
+}
+
+/* Timed region */
+
+static inline void bench_start(bench_ctx_t *ctx)
+{
+    counters_start(ctx->ctr);
+    clock_gettime(CLOCK_MONOTONIC, &ctx->start);
+}
+
+static inline void bench_stop(bench_ctx_t *ctx)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    counters_stop(ctx->ctr, ctx->sample);
+    ctx->sample->ns = (end.tv_sec - ctx->start.tv_sec) * 1e9 +
+                      (end.tv_nsec - ctx->start.tv_nsec);
+}
+
+/* Queue setup helpers, none of which is timed */
+
+static bq_t *build_queue(char **keys, int n)
+{
+    bq_t *q = bq_new();
+    if (!q)
+        return NULL;
+    for (int i = 0; i < n; i++) {
+        if (!bq_insert_tail(q, keys[i])) {
+            bq_free(q);
+            return NULL;
+        }
+    }
+    return q;
+}
+
+static bq_t *build_sorted(bench_ctx_t *ctx)
+{
+    bq_t *q = build_queue(ctx->keys, ctx->n);
+    if (q)
+        bq_sort(q, false);
+    return q;
+}
+
+/* Benchmarks */
+
+static size_t bench_insert_head(bench_ctx_t *ctx)
+{
+    bq_t *q = bq_new();
+    if (!q)
+        return 0;
+    bench_start(ctx);
+    for (int i = 0; i < ctx->n; i++)
+        bq_insert_head(q, ctx->keys[i]);
+    bench_stop(ctx);
+    bq_free(q);
+    return ctx->n;
+}
+
+static size_t bench_insert_tail(bench_ctx_t *ctx)
+{
+    bq_t *q = bq_new();
+    if (!q)
+        return 0;
+    bench_start(ctx);
+    for (int i = 0; i < ctx->n; i++)
+        bq_insert_tail(q, ctx->keys[i]);
+    bench_stop(ctx);
+    bq_free(q);
+    return ctx->n;
+}
+
+#ifndef QBENCH_UNROLLED
+static size_t bench_insert_many(bench_ctx_t *ctx, bool tail)
+{
+    bq_t *q = q_new();
+    if (!q)
+        return 0;
+    bench_start(ctx);
+    bool ok = tail ? q_insert_tail_many(q, ctx->keys, ctx->n)
+                   : q_insert_head_many(q, ctx->keys, ctx->n);
+    bench_stop(ctx);
+    q_free(q);
+    return ok ? ctx->n : 0;
+}
+
+/* Drain the queue in batches of CUT_BATCH, releasing each batch at once */
+static size_t bench_cut_head(bench_ctx_t *ctx)
+{
+    bq_t *q = build_queue(ctx->keys, ctx->n);
+    if (!q)
+        return 0;
+    struct list_head batch;
+    bench_start(ctx);
+    while (q_cut_head(q, &batch, CUT_BATCH))
+        q_release_list(&batch);
+    bench_stop(ctx);
+    q_free(q);
+    return ctx->n;
+}
+
+static size_t bench_insert_head_many(bench_ctx_t *ctx)
+{
+    return bench_insert_many(ctx, false);
+}
+
+static size_t bench_insert_tail_many(bench_ctx_t *ctx)
+{
+    return bench_insert_many(ctx, true);
+}
+#endif
+
+static size_t bench_remove(bench_ctx_t *ctx, bool tail)
+{
+    bq_t *q = build_queue(ctx->keys, ctx->n);
+    if (!q)
+        return 0;
+    char sp[REMOVE_BUFSIZE];
+
+#ifdef QBENCH_UNROLLED
+    /* The strings are released as part of the removal */
+    bench_start(ctx);
+    for (int i = 0; i < ctx->n; i++) {
+        tail ? uq_remove_tail(q, sp, sizeof(sp))
+             : uq_remove_head(q, sp, sizeof(sp));
+    }
+    bench_stop(ctx);
+#else
+    element_t **removed = malloc(sizeof(*removed) * ctx->n);
+    if (!removed) {
+        q_free(q);
+        return 0;
+    }
+
+    bench_start(ctx);
+    for (int i = 0; i < ctx->n; i++) {
+        removed[i] = tail ? q_remove_tail(q, sp, sizeof(sp))
+                          : q_remove_head(q, sp, sizeof(sp));
+    }
+    bench_stop(ctx);
+
+    /* Releasing is left out, bench_free covers it */
+    for (int i = 0; i < ctx->n; i++)
+        q_release_element(removed[i]);
+    free(removed);
+#endif
+
+    bq_free(q);
+    return ctx->n;
+}
+
+static size_t bench_remove_head(bench_ctx_t *ctx)
+{
+    return bench_remove(ctx, false);
+}
+
+static size_t bench_remove_tail(bench_ctx_t *ctx)
+{
+    return bench_remove(ctx, true);
+}
+
+static size_t bench_size(bench_ctx_t *ctx)
+{
+    bq_t *q = build_queue(ctx->keys, ctx->n);
+    if (!q)
+        return 0;
+    volatile int sink = 0;
+    bench_start(ctx);
+    for (int i = 0; i < ctx->n; i++)
+        sink += bq_size(q);
+    bench_stop(ctx);
+    (void) sink;
+    bq_free(q);
+    return ctx->n;
+}
+
+static size_t bench_free(bench_ctx_t *ctx)
+{
+    bq_t *q = build_queue(ctx->keys, ctx->n);
+    if (!q)
+        return 0;
+    bench_start(ctx);
+    bq_free(q);
+    bench_stop(ctx);
+    return ctx->n;
+}
+
+#ifndef QBENCH_UNROLLED
+/* Same as free, for a queue whose elements come from an arena */
+static size_t bench_free_arena(bench_ctx_t *ctx)
+{
+    bq_t *q = q_new_arena();
+    if (!q)
+        return 0;
+    for (int i = 0; i < ctx->n; i++) {
+        if (!q_insert_tail(q, ctx->keys[i])) {
+            q_free(q);
+            return 0;
+        }
+    }
+    bench_start(ctx);
+    q_free(q);
+    bench_stop(ctx);
+    return ctx->n;
+}
+#endif
+
+#ifndef QBENCH_UNROLLED
+/* Look every key up in the sorted queue through its skip-list index */
+static size_t bench_index_find(bench_ctx_t *ctx)
+{
+    bq_t *q = build_sorted(ctx);
+    if (!q)
+        return 0;
+    size_t ops = 0;
+    if (q_index_build(q)) {
+        bench_start(ctx);
+        for (int i = 0; i < ctx->n; i++)
+            q_index_find(q, ctx->keys[i]);
+        bench_stop(ctx);
+        ops = ctx->n;
+    }
+    q_free(q);
+    return ops;
+}
+
+/* Insert every key in order into a queue kept sorted by its index */
+static size_t bench_index_insert(bench_ctx_t *ctx)
+{
+    bq_t *q = q_new();
+    if (!q)
+        return 0;
+    size_t ops = 0;
+    if (q_index_build(q)) {
+        bench_start(ctx);
+        for (int i = 0; i < ctx->n; i++)
+            q_index_insert(q, ctx->keys[i]);
+        bench_stop(ctx);
+        ops = ctx->n;
+    }
+    q_free(q);
+    return ops;
+}
+
+/* Pop every element of a pairing heap holding all the keys */
+static size_t bench_pq_pop(bench_ctx_t *ctx)
+{
+    bq_t *q = build_queue(ctx->keys, ctx->n);
+    pqueue_t *pq = pq_new();
+    if (!q || !pq || !pq_push_queue(pq, q)) {
+        pq_free(pq);
+        q_free(q);
+        return 0;
+    }
+    bench_start(ctx);
+    for (int i = 0; i < ctx->n; i++)
+        q_release_element(pq_pop_min(pq));
+    bench_stop(ctx);
+    pq_free(pq);
+    q_free(q);
+    return ctx->n;
+}
+#endif
+
+static size_t bench_delete_mid(bench_ctx_t *ctx)
+{
+    bq_t *q = build_queue(ctx->keys, ctx->n);
+    if (!q)
+        return 0;
+    int calls = ctx->n < DELETE_MID_CALLS ? ctx->n : DELETE_MID_CALLS;
+    bench_start(ctx);
+    for (int i = 0; i < calls; i++)
+        bq_delete_mid(q);
+    bench_stop(ctx);
+    bq_free(q);
+    return calls;
+}
+
+static size_t bench_delete_dup(bench_ctx_t *ctx)
+{
+    bq_t *q = build_sorted(ctx);
+    if (!q)
+        return 0;
+    bench_start(ctx);
+    bq_delete_dup(q);
+    bench_stop(ctx);
+    bq_free(q);
+    return ctx->n;
+}
+
+/* Generate a benchmark for an operation over the whole queue */
+#define BENCH_WHOLE(name, call)                   \
+    static size_t bench_##name(bench_ctx_t *ctx)  \
+    {                                             \
+        bq_t *q = build_queue(ctx->keys, ctx->n); \
+        if (!q)                                   \
+            return 0;                             \
+        bench_start(ctx);                         \
+        call;                                     \
+        bench_stop(ctx);                          \
+        bq_free(q);                               \
+        return ctx->n;                            \
+    }
+
+#ifdef QBENCH_UNROLLED
+BENCH_WHOLE(swap, uq_swap(q))
+BENCH_WHOLE(reverse, uq_reverse(q))
+BENCH_WHOLE(reverseK, uq_reverseK(q, reverse_k))
+BENCH_WHOLE(sort, uq_sort(q, false))
+BENCH_WHOLE(ascend, uq_ascend(q))
+BENCH_WHOLE(descend, uq_descend(q))
+BENCH_WHOLE(shuffle, uq_shuffle(q))
+#else
+BENCH_WHOLE(swap, q_swap(q))
+BENCH_WHOLE(reverse, q_reverse(q))
+BENCH_WHOLE(reverseK, q_reverseK(q, reverse_k))
+BENCH_WHOLE(rotate, q_rotate(q, ctx->n / 3))
+BENCH_WHOLE(sort, q_sort(q, false))
+BENCH_WHOLE(sort_key, q_sort_key(q, false))
+BENCH_WHOLE(sort_parallel, q_sort_parallel(q, false, sort_threads))
+BENCH_WHOLE(ascend, q_ascend(q))
+BENCH_WHOLE(descend, q_descend(q))
+BENCH_WHOLE(shuffle, q_shuffle(q))
+BENCH_WHOLE(shuffle_merge, q_shuffle_merge(q))
+BENCH_WHOLE(delete_dup_hash, q_delete_dup_hash(q))
+#endif
+
+#ifdef QBENCH_UNROLLED
+/* Deal the keys round-robin into merge_queues sorted queues and merge them in
+ * rounds, as q_merge_pairwise() does.
+ */
+static size_t bench_merge(bench_ctx_t *ctx)
+{
+    int k = merge_queues < ctx->n ? merge_queues : ctx->n;
+    uqueue_t **qs = calloc(k, sizeof(*qs));
+    if (!qs)
+        return 0;
+
+    bool ok = true;
+    for (int i = 0; i < k; i++)
+        ok = (qs[i] = uq_new()) && ok;
+    for (int i = 0; ok && i < ctx->n; i++)
+        ok = uq_insert_tail(qs[i % k], ctx->keys[i]);
+    for (int i = 0; ok && i < k; i++)
+        ok = uq_sort(qs[i], false);
+
+    size_t ops = 0;
+    if (ok) {
+        bench_start(ctx);
+        for (int step = 1; ok && step < k; step *= 2) {
+            for (int i = 0; ok && i + step < k; i += 2 * step)
+                ok = uq_merge(qs[i], qs[i + step], false);
+        }
+        bench_stop(ctx);
+        ops = ok ? ctx->n : 0;
+    }
+
+    for (int i = 0; i < k; i++)
+        uq_free(qs[i]);
+    free(qs);
+    return ops;
+}
+#else
+/* Deal the keys round-robin into merge_queues sorted queues and merge them */
+static size_t bench_merge_chain(bench_ctx_t *ctx, bool pairwise)
+{
+    int k = merge_queues < ctx->n ? merge_queues : ctx->n;
+    queue_contex_t *ctxs = calloc(k, sizeof(*ctxs));
+    if (!ctxs)
+        return 0;
+
+    struct list_head chain;
+    INIT_LIST_HEAD(&chain);
+    bool ok = true;
+    for (int i = 0; i < k; i++) {
+        ctxs[i].q = q_new();
+        ctxs[i].id = i;
+        list_add_tail(&ctxs[i].chain, &chain);
+        ok = ok && ctxs[i].q;
+    }
+    for (int i = 0; ok && i < ctx->n; i++)
+        ok = q_insert_tail(ctxs[i % k].q, ctx->keys[i]);
+
+    size_t ops = 0;
+    if (ok) {
+        for (int i = 0; i < k; i++) {
+            q_sort(ctxs[i].q, false);
+            ctxs[i].size = q_size(ctxs[i].q);
+        }
+        bench_start(ctx);
+        if (pairwise)
+            q_merge_pairwise(&chain, false);
+        else
+            q_merge(&chain, false);
+        bench_stop(ctx);
+        ops = ctx->n;
+    }
+
+    for (int i = 0; i < k; i++)
+        q_free(ctxs[i].q);
+    free(ctxs);
+    return ops;
+}
+
+static size_t bench_merge(bench_ctx_t *ctx)
+{
+    return bench_merge_chain(ctx, false);
+}
+
+static size_t bench_merge_pairwise(bench_ctx_t *ctx)
+{
+    return bench_merge_chain(ctx, true);
+}
+#endif
+
+static const bench_t benches[] = {
+    {"insert_head", bench_insert_head},
+    {"insert_tail", bench_insert_tail},
+    {"remove_head", bench_remove_head},
+    {"remove_tail", bench_remove_tail},
+    {"size", bench_size},
+    {"free", bench_free},
+    {"delete_mid", bench_delete_mid},
+    {"delete_dup", bench_delete_dup},
+    {"swap", bench_swap},
+    {"reverse", bench_reverse},
+    {"reverseK", bench_reverseK},
+    {"sort", bench_sort},
+    {"ascend", bench_ascend},
+    {"descend", bench_descend},
+    {"merge", bench_merge},
+    {"shuffle", bench_shuffle},
+#ifndef QBENCH_UNROLLED
+    {"insert_head_many", bench_insert_head_many},
+    {"insert_tail_many", bench_insert_tail_many},
+    {"cut_head", bench_cut_head},
+    {"free_arena", bench_free_arena},
+    {"index_find", bench_index_find},
+    {"index_insert", bench_index_insert},
+    {"pq_pop", bench_pq_pop},
+    {"rotate", bench_rotate},
+    {"sort_key", bench_sort_key},
+    {"sort_parallel", bench_sort_parallel},
+    {"merge_pairwise", bench_merge_pairwise},
+    {"shuffle_merge", bench_shuffle_merge},
+    {"delete_dup_hash", bench_delete_dup_hash},
+#endif
+};
+
+/* Reporting */
+
+static int cmp_sample(const void *a, const void *b)
+{
+    double x = ((const sample_t *) a)->ns, y = ((const sample_t *) b)->ns;
+    return (x > y) - (x < y);
+}
+
+static void report_header(void)
+{
+    switch (format) {
+    case FMT_CSV:
+        printf("backend,op,dist,n,ops,ns_per_op,mops_per_s");
+        for (int i = 0; i < NR_EVENTS; i++)
+            printf(",%s_per_op", event_names[i]);
+        printf("\n");
+        break;
+    case FMT_JSON:
+        printf("[");
+        break;
+    default:
+        printf("backend: %s\n", BACKEND);
+        printf("%-17s %-8s %9s %10s %10s", "op", "dist", "n", "ns/op",
+               "Mops/s");
+        for (int i = 0; i < NR_EVENTS; i++)
+            printf(" %14s", event_names[i]);
+        printf("\n");
+        break;
+    }
+}
+
+/* One line per (op, dist, n) with the median of the repeated runs */
+static void report_result(const char *op,
+                          const char *dist,
+                          int n,
+                          size_t ops,
+                          const sample_t *s,
+                          bool first)
+{
+    double ns_op = s->ns / ops;
+    double mops = s->ns > 0 ? ops / s->ns * 1e3 : 0;
+
+    switch (format) {
+    case FMT_CSV:
+        printf("%s,%s,%s,%d,%zu,%.3f,%.3f", BACKEND, op, dist, n, ops, ns_op,
+               mops);
+        for (int i = 0; i < NR_EVENTS; i++) {
+            if (s->valid[i])
+                printf(",%.3f", (double) s->count[i] / ops);
+            else
+                printf(",");
+        }
+        printf("\n");
+        break;
+    case FMT_JSON:
+        printf("%s\n  {\"backend\": \"%s\", \"op\": \"%s\", \"dist\": \"%s\", "
+               "\"n\": %d, \"ops\": %zu, \"ns_per_op\": %.3f, "
+               "\"mops_per_s\": %.3f",
+               first ? "" : ",", BACKEND, op, dist, n, ops, ns_op, mops);
+        for (int i = 0; i < NR_EVENTS; i++) {
+            if (s->valid[i])
+                printf(", \"%s_per_op\": %.3f", event_names[i],
+                       (double) s->count[i] / ops);
+            else
+                printf(", \"%s_per_op\": null", event_names[i]);
+        }
+        printf("}");
+        break;
+    default:
+        printf("%-17s %-8s %9d %10.2f %10.2f", op, dist, n, ns_op, mops);
+        for (int i = 0; i < NR_EVENTS; i++) {
+            if (s->valid[i])
+                printf(" %14.2f", (double) s->count[i] / ops);
+            else
+                printf(" %14s", "-");
+        }
+        printf("\n");
+        break;
+    }
+    fflush(stdout);
+}
+
+static void report_footer(void)
+{
+    if (format == FMT_JSON)
+        printf("\n]\n");
+}
+
+/* Command line */
+
+static void usage(char *cmd)
+{
+    printf("Usage: %s [-h] [-n SIZES] [-d DISTS] [-o OPS] [-r REPEATS]\n",
+           cmd);
+    printf("          [-k K] [-m QUEUES] [-t THREADS] [-s SEED] [-f FMT]\n");
+    printf("\t-h         Print this information\n");
+    printf("\t-n SIZES   Comma separated queue sizes (default 1000,100000)\n");
+    printf("\t-d DISTS   Comma separated key distributions (default random)\n");
+    printf("\t-o OPS     Comma separated operations (default all)\n");
+    printf("\t-r REPEATS Runs per result, the median is reported (default "
+           "%d)\n",
+           repeats);
+    printf("\t-k K       Group size for reverseK (default %d)\n", reverse_k);
+    printf("\t-m QUEUES  Number of queues for merge (default %d)\n",
+           merge_queues);
+    printf("\t-t THREADS Threads for sort_parallel (default %d)\n",
+           sort_threads);
+    printf("\t-s SEED    Seed of the key generator\n");
+    printf("\t-f FMT     Output format: text, csv or json (default text)\n");
+    printf("Distributions:");
+    const keygen_dist_t *dist;
+    for (size_t i = 0; (dist = keygen_dist(i)); i++)
+        printf(" %s", keygen_name(dist));
+    printf("\nOperations:");
+    for (size_t i = 0; i < ARRAY_SIZE(benches); i++)
+        printf("%s %s", i % 8 == 7 ? "\n\t" : "", benches[i].name);
+    printf("\nWhole-queue operations count one op per element.\n");
+    exit(0);
+}
+
+static bool parse_int(const char *s, long min, long max, long *val)
+{
+    char *end;
+    errno = 0;
+    long v = strtol(s, &end, 0);
+    if (errno || end == s || *end || v < min || v > max)
+        return false;
+    *val = v;
+    return true;
+}
+
+/* Does comma separated list include name? An empty list includes all */
+static bool listed(const char *list, const char *name)
+{
+    if (!list)
+        return true;
+    size_t len = strlen(name);
+    for (const char *p = list; *p;) {
+        const char *comma = strchr(p, ',');
+        size_t n = comma ? (size_t) (comma - p) : strlen(p);
+        if (n == len && !strncmp(p, name, len))
+            return true;
+        p += comma ? n + 1 : n;
+    }
+    return false;
+}
+
+static void get_opt_int(int c, long min, long max, long *val)
+{
+    if (parse_int(optarg, min, max, val))
+        return;
+    fprintf(stderr, "Invalid argument for -%c: '%s'\n", c, optarg);
+    exit(EXIT_FAILURE);
+}
+
+/* Copy the next item of a comma separated list into buf, skip past it */
+static const char *next_item(const char *p, char *buf, size_t size)
+{
+    size_t len = strcspn(p, ",");
+    snprintf(buf, size, "%.*s", (int) len, p);
+    return p[len] ? p + len + 1 : p + len;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *sizes = "1000,100000";
+    const char *dist_list = "random";
+    const char *op_list = NULL;
+    long v;
+    int c;
+
+    while ((c = getopt(argc, argv, "hn:d:o:r:k:m:t:s:f:")) != -1) {
+        switch (c) {
+        case 'h':
+            usage(argv[0]);
+            break;
+        case 'n':
+            sizes = optarg;
+            break;
+        case 'd':
+            dist_list = optarg;
+            break;
+        case 'o':
+            op_list = optarg;
+            break;
+        case 'r':
+            get_opt_int(c, 1, MAX_REPEATS, &v);
+            repeats = v;
+            break;
+        case 'k':
+            get_opt_int(c, 1, INT_MAX, &v);
+            reverse_k = v;
+            break;
+        case 'm':
+            get_opt_int(c, 1, INT_MAX, &v);
+            merge_queues = v;
+            break;
+        case 't':
+            get_opt_int(c, 1, INT_MAX, &v);
+            sort_threads = v;
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'f':
+            if (!strcmp(optarg, "csv"))
+                format = FMT_CSV;
+            else if (!strcmp(optarg, "json"))
+                format = FMT_JSON;
+            else if (!strcmp(optarg, "text"))
+                format = FMT_TEXT;
+            else {
+                fprintf(stderr, "Unknown format '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        default:
+            usage(argv[0]);
+            break;
+        }
+    }
+
+    /* Validate the lists up front rather than silently running nothing */
+    char num[32];
+    for (const char *p = sizes; *p;) {
+        p = next_item(p, num, sizeof(num));
+        if (!parse_int(num, 1, INT_MAX, &v)) {
+            fprintf(stderr, "Invalid queue size '%s'\n", num);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    counters_t ctr;
+    counters_init(&ctr);
+    sample_t samples[MAX_REPEATS];
+    bool first = true;
+
+    report_header();
+    for (const char *p = sizes; *p;) {
+        p = next_item(p, num, sizeof(num));
+        parse_int(num, 1, INT_MAX, &v);
+
+        int n = v;
+        char **keys = malloc(sizeof(*keys) * n);
+        if (!keys) {
+            fprintf(stderr, "Cannot allocate %d keys\n", n);
+            exit(EXIT_FAILURE);
+        }
+
+        const keygen_dist_t *dist;
+        for (size_t d = 0; (dist = keygen_dist(d)); d++) {
+            if (!listed(dist_list, keygen_name(dist)))
+                continue;
+            char *pool = keygen_make(dist, keys, n, seed);
+            if (!pool) {
+                fprintf(stderr, "Cannot allocate %d keys\n", n);
+                exit(EXIT_FAILURE);
+            }
+
+            for (size_t b = 0; b < ARRAY_SIZE(benches); b++) {
+                if (!listed(op_list, benches[b].name))
+                    continue;
+                size_t ops = 0;
+                for (int r = 0; r < repeats; r++) {
+                    bench_ctx_t ctx = {
+                        .keys = keys,
+                        .n = n,
+                        .ctr = &ctr,
+                        .sample = &samples[r],
+                    };
+                    ops = benches[b].func(&ctx);
+                    if (!ops)
+                        break;
+                }
+                if (!ops) {
+                    fprintf(stderr, "%s: out of memory at n = %d\n",
+                            benches[b].name, n);
+                    continue;
+                }
+                qsort(samples, repeats, sizeof(*samples), cmp_sample);
+                report_result(benches[b].name, keygen_name(dist), n, ops,
+                              &samples[repeats / 2], first);
+                first = false;
+            }
+            free(pool);
+        }
+        free(keys);
+    }
+    report_footer();
+
+    counters_free(&ctr);
+    return allocation_check() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
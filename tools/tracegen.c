@@ -0,0 +1,196 @@
+/* Trace generator for qtest
+ *
+ * Writes a trace that inserts keys drawn from one of the distributions of
+ * keygen.h, one literal "it" command per key, then runs the given commands on
+ * them. Such traces can be compiled with scripts/compile-trace.py and replayed
+ * at full speed.
+ *
+ * With -S, writes instead the perf trace suite: one trace per distribution,
+ * which extends trace-15-perf to keys that are not uniformly random. Those
+ * traces let qtest generate the keys through its gen command, so they stay
+ * small.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "keygen.h"
+
+/* Queue sizes of every trace of the suite, as in trace-15-perf */
+static const int suite_sizes[] = {10000, 50000, 100000};
+
+/* What the keys of each distribution look like, for the suite headers */
+static const struct {
+    const char *dist;
+    const char *desc;
+} descs[] = {
+    {"random", "uniformly random"},
+    {"sorted", "already sorted"},
+    {"reverse", "reverse sorted"},
+    {"nearly", "nearly sorted"},
+    {"dup", "heavily duplicated"},
+    {"zipf", "Zipf distributed"},
+    {"prefix", "long-prefixed"},
+};
+
+static void usage(char *cmd)
+{
+    printf("Usage: %s [-h] [-d DIST] [-n N] [-s SEED] [-o OPS] [-S DIR]\n",
+           cmd);
+    printf("\t-h       Print this information\n");
+    printf("\t-d DIST  Key distribution (default random)\n");
+    printf("\t-n N     Number of keys (default 10000)\n");
+    printf("\t-s SEED  Seed of the key generator (default 1)\n");
+    printf("\t-o OPS   Comma separated commands run on the keys (default "
+           "sort)\n");
+    printf("\t-S DIR   Write the perf trace suite into DIR instead\n");
+    printf("Distributions:");
+    const keygen_dist_t *dist;
+    for (size_t i = 0; (dist = keygen_dist(i)); i++)
+        printf(" %s", keygen_name(dist));
+    printf("\n");
+    exit(0);
+}
+
+static const char *describe(const char *dist)
+{
+    for (size_t i = 0; i < sizeof(descs) / sizeof(descs[0]); i++) {
+        if (!strcmp(descs[i].dist, dist))
+            return descs[i].desc;
+    }
+    return dist;
+}
+
+/* Write a trace with literal keys */
+static bool write_trace(FILE *f,
+                        const keygen_dist_t *dist,
+                        int n,
+                        uint64_t seed,
+                        const char *ops)
+{
+    char **keys = malloc(sizeof(char *) * n);
+    char *pool = keys ? keygen_make(dist, keys, n, seed) : NULL;
+    if (!pool) {
+        free(keys);
+        return false;
+    }
+
+    fprintf(f, "# %d %s keys, seed %" PRIu64 ", generated by tracegen\n", n,
+            describe(keygen_name(dist)), seed);
+    fprintf(f, "option fail 0\noption malloc 0\nnew\n");
+    for (int i = 0; i < n; i++)
+        fprintf(f, "it %s\n", keys[i]);
+    for (const char *p = ops; *p;) {
+        size_t len = strcspn(p, ",");
+        fprintf(f, "%.*s\n", (int) len, p);
+        p += len + (p[len] == ',');
+    }
+    fprintf(f, "free\n");
+
+    free(pool);
+    free(keys);
+    return !ferror(f);
+}
+
+/* Write one trace per distribution into dir */
+static bool write_suite(const char *dir, uint64_t seed)
+{
+    if (mkdir(dir, 0755) && errno != EEXIST) {
+        perror(dir);
+        return false;
+    }
+
+    const keygen_dist_t *dist;
+    for (size_t d = 0; (dist = keygen_dist(d)); d++) {
+        const char *name = keygen_name(dist);
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/trace-perf-%s.cmd", dir, name);
+        FILE *f = fopen(path, "w");
+        if (!f) {
+            perror(path);
+            return false;
+        }
+
+        fprintf(f,
+                "# Test performance on %s keys: 'q_new', 'q_free', "
+                "'q_insert_tail', 'q_sort', 'q_reverse' and 'q_delete_dup'\n",
+                describe(name));
+        fprintf(f,
+                "# Generated by tracegen -S, extending trace-15-perf to other "
+                "key distributions\n");
+        fprintf(f, "option fail 0\noption malloc 0\n");
+        for (size_t i = 0; i < sizeof(suite_sizes) / sizeof(suite_sizes[0]);
+             i++) {
+            fprintf(f, "new\ngen %s %d %" PRIu64 "\n", name, suite_sizes[i],
+                    seed);
+            fprintf(f, "sort\nreverse\nsort\ndedup\nfree\n");
+        }
+
+        bool ok = !ferror(f);
+        if (fclose(f) || !ok) {
+            perror(path);
+            return false;
+        }
+        printf("%s\n", path);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dist_name = "random", *ops = "sort", *suite = NULL;
+    uint64_t seed = 1;
+    long n = 10000;
+    char *end;
+    int c;
+
+    while ((c = getopt(argc, argv, "hd:n:s:o:S:")) != -1) {
+        switch (c) {
+        case 'd':
+            dist_name = optarg;
+            break;
+        case 'n':
+            errno = 0;
+            n = strtol(optarg, &end, 0);
+            if (errno || *end || n < 1 || n > INT_MAX) {
+                fprintf(stderr, "Invalid number of keys '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'o':
+            ops = optarg;
+            break;
+        case 'S':
+            suite = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            break;
+        }
+    }
+
+    if (suite)
+        return write_suite(suite, seed) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    const keygen_dist_t *dist = keygen_find(dist_name);
+    if (!dist) {
+        fprintf(stderr, "Unknown key distribution '%s'\n", dist_name);
+        exit(EXIT_FAILURE);
+    }
+    if (!write_trace(stdout, dist, n, seed, ops)) {
+        fprintf(stderr, "Cannot write %ld keys\n", n);
+        exit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+}
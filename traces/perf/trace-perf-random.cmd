@@ -0,0 +1,25 @@
+# Test performance on uniformly random keys: 'q_new', 'q_free', 'q_insert_tail', 'q_sort', 'q_reverse' and 'q_delete_dup'
+# Generated by tracegen -S, extending trace-15-perf to other key distributions
+option fail 0
+option malloc 0
+new
+gen random 10000 1
+sort
+reverse
+sort
+dedup
+free
+new
+gen random 50000 1
+sort
+reverse
+sort
+dedup
+free
+new
+gen random 100000 1
+sort
+reverse
+sort
+dedup
+free
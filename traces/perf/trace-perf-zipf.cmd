@@ -0,0 +1,25 @@
+# Test performance on Zipf distributed keys: 'q_new', 'q_free', 'q_insert_tail', 'q_sort', 'q_reverse' and 'q_delete_dup'
+# Generated by tracegen -S, extending trace-15-perf to other key distributions
+option fail 0
+option malloc 0
+new
+gen zipf 10000 1
+sort
+reverse
+sort
+dedup
+free
+new
+gen zipf 50000 1
+sort
+reverse
+sort
+dedup
+free
+new
+gen zipf 100000 1
+sort
+reverse
+sort
+dedup
+free
@@ -0,0 +1,20 @@
+# Test performance of the pairing heap: 'pq_push', 'pq_pop' and 'pq_meld'
+# 10000: all correct priority queues are expected pass
+# 50000: priority queues with O(n) removal are expected failed
+# 100000: priority queues with O(logn) amortized removal are expected pass
+option fail 0
+option malloc 0
+pq_push RAND 10000
+pq_pop 10000
+new
+ih RAND 50000
+pq_meld
+pq_push RAND 50000
+pq_pop 100000
+free
+new
+ih RAND 100000
+pq_meld
+pq_push RAND 100000
+pq_pop 200000
+free
@@ -0,0 +1,47 @@
+# Test of 'q_new', 'q_insert_tail', 'q_remove_head' and 'q_rotate' by K on both sides of n/2, and by negative K
+option fail 0
+option malloc 0
+new
+it a
+it b
+it c
+it d
+rotate 3
+rh d
+rh a
+rh b
+rh c
+it a
+it b
+it c
+it d
+rotate -1
+rh d
+rh a
+rh b
+rh c
+it a
+it b
+it c
+it d
+it e
+rotate 1
+rotate 7
+rotate -2
+rh b
+rh c
+rh d
+rh e
+rh a
+it a
+it b
+it c
+it d
+it e
+rotate 4
+rh e
+rh a
+rh b
+rh c
+rh d
+free
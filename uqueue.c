@@ -0,0 +1,541 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "random.h"
+#include "uqueue.h"
+
+/* Position of a string in the queue, or past the end when c is the head */
+typedef struct {
+    uq_chunk_t *c;
+    int i;
+} uq_pos_t;
+
+#define POS_VAL(p) ((p).c->values[(p).i])
+
+static inline bool pos_end(uqueue_t *uq, uq_pos_t p)
+{
+    return &p.c->list == &uq->chunks;
+}
+
+static inline uq_pos_t pos_first(uqueue_t *uq)
+{
+    uq_pos_t p = {list_first_entry(&uq->chunks, uq_chunk_t, list), 0};
+    if (!pos_end(uq, p))
+        p.i = p.c->begin;
+    return p;
+}
+
+static inline void pos_next(uqueue_t *uq, uq_pos_t *p)
+{
+    if (++p->i < p->c->end)
+        return;
+    p->c = list_entry(p->c->list.next, uq_chunk_t, list);
+    p->i = pos_end(uq, *p) ? 0 : p->c->begin;
+}
+
+static inline void pos_prev(uqueue_t *uq, uq_pos_t *p)
+{
+    if (!pos_end(uq, *p) && p->i > p->c->begin) {
+        p->i--;
+        return;
+    }
+    p->c = list_entry(p->c->list.prev, uq_chunk_t, list);
+    p->i = pos_end(uq, *p) ? 0 : p->c->end - 1;
+}
+
+/* Move n strings forward, which the caller knows are there */
+static void pos_advance(uq_pos_t *p, int n)
+{
+    while (n > p->c->end - 1 - p->i) {
+        n -= p->c->end - p->i;
+        p->c = list_entry(p->c->list.next, uq_chunk_t, list);
+        p->i = p->c->begin;
+    }
+    p->i += n;
+}
+
+/* Empty chunk whose free slots all lie on one side of at */
+static uq_chunk_t *chunk_new(int at)
+{
+    uq_chunk_t *c = malloc(sizeof(uq_chunk_t));
+    if (c)
+        c->begin = c->end = at;
+    return c;
+}
+
+static void chunk_drop(uq_chunk_t *c)
+{
+    list_del(&c->list);
+    free(c);
+}
+
+static void copy_out(const char *v, char *sp, size_t bufsize)
+{
+    if (!sp || !bufsize)
+        return;
+    size_t len = strnlen(v, bufsize - 1);
+    memcpy(sp, v, len);
+    sp[len] = '\0';
+}
+
+/* Create an empty queue */
+uqueue_t *uq_new(void)
+{
+    uqueue_t *uq = malloc(sizeof(uqueue_t));
+    if (!uq)
+        return NULL;
+    INIT_LIST_HEAD(&uq->chunks);
+    uq->size = 0;
+    return uq;
+}
+
+/* Free all storage used by queue */
+void uq_free(uqueue_t *uq)
+{
+    if (!uq)
+        return;
+    uq_chunk_t *c, *safe;
+    list_for_each_entry_safe(c, safe, &uq->chunks, list) {
+        for (int i = c->begin; i < c->end; i++)
+            free(c->values[i]);
+        free(c);
+    }
+    free(uq);
+}
+
+/* Insert a copy of a string at the head */
+bool uq_insert_head(uqueue_t *uq, const char *s)
+{
+    if (!uq)
+        return false;
+    char *v = strdup(s);
+    if (!v)
+        return false;
+
+    uq_chunk_t *c = list_first_entry(&uq->chunks, uq_chunk_t, list);
+    if (list_empty(&uq->chunks) || !c->begin) {
+        c = chunk_new(UQ_CHUNK);
+        if (!c) {
+            free(v);
+            return false;
+        }
+        list_add(&c->list, &uq->chunks);
+    }
+    c->values[--c->begin] = v;
+    uq->size++;
+    return true;
+}
+
+/* Insert a copy of a string at the tail */
+bool uq_insert_tail(uqueue_t *uq, const char *s)
+{
+    if (!uq)
+        return false;
+    char *v = strdup(s);
+    if (!v)
+        return false;
+
+    uq_chunk_t *c = list_last_entry(&uq->chunks, uq_chunk_t, list);
+    if (list_empty(&uq->chunks) || c->end == UQ_CHUNK) {
+        c = chunk_new(0);
+        if (!c) {
+            free(v);
+            return false;
+        }
+        list_add_tail(&c->list, &uq->chunks);
+    }
+    c->values[c->end++] = v;
+    uq->size++;
+    return true;
+}
+
+/* Remove the string at the head of queue */
+bool uq_remove_head(uqueue_t *uq, char *sp, size_t bufsize)
+{
+    if (!uq || !uq->size)
+        return false;
+    uq_chunk_t *c = list_first_entry(&uq->chunks, uq_chunk_t, list);
+    char *v = c->values[c->begin++];
+    copy_out(v, sp, bufsize);
+    free(v);
+    if (c->begin == c->end)
+        chunk_drop(c);
+    uq->size--;
+    return true;
+}
+
+/* Remove the string at the tail of queue */
+bool uq_remove_tail(uqueue_t *uq, char *sp, size_t bufsize)
+{
+    if (!uq || !uq->size)
+        return false;
+    uq_chunk_t *c = list_last_entry(&uq->chunks, uq_chunk_t, list);
+    char *v = c->values[--c->end];
+    copy_out(v, sp, bufsize);
+    free(v);
+    if (c->begin == c->end)
+        chunk_drop(c);
+    uq->size--;
+    return true;
+}
+
+/* Return number of strings in queue */
+int uq_size(uqueue_t *uq)
+{
+    return uq ? uq->size : 0;
+}
+
+/* Delete the middle string in queue */
+bool uq_delete_mid(uqueue_t *uq)
+{
+    if (!uq || !uq->size)
+        return false;
+
+    int m = (uq->size - 1) / 2;
+    uq_chunk_t *c;
+    list_for_each_entry(c, &uq->chunks, list) {
+        if (m < c->end - c->begin)
+            break;
+        m -= c->end - c->begin;
+    }
+
+    /* Close the gap from whichever side of the chunk moves fewer pointers */
+    int i = c->begin + m;
+    free(c->values[i]);
+    if (i - c->begin < c->end - 1 - i) {
+        memmove(&c->values[c->begin + 1], &c->values[c->begin],
+                sizeof(char *) * (i - c->begin));
+        c->begin++;
+    } else {
+        memmove(&c->values[i], &c->values[i + 1],
+                sizeof(char *) * (c->end - 1 - i));
+        c->end--;
+    }
+    if (c->begin == c->end)
+        chunk_drop(c);
+    uq->size--;
+    return true;
+}
+
+/* The deletions below compact the strings they keep towards the head: w is
+ * where the next kept string goes, and it never passes the string being read.
+ * Once done, everything from w on is dropped. The strings there were either
+ * moved forward or released already.
+ */
+static void truncate_at(uqueue_t *uq, uq_pos_t w)
+{
+    if (pos_end(uq, w))
+        return;
+    while (w.c->list.next != &uq->chunks)
+        chunk_drop(list_entry(w.c->list.next, uq_chunk_t, list));
+    w.c->end = w.i;
+    if (w.c->begin == w.c->end)
+        chunk_drop(w.c);
+}
+
+/* Delete all strings that are duplicated in a sorted queue */
+bool uq_delete_dup(uqueue_t *uq)
+{
+    if (!uq || !uq->size)
+        return false;
+
+    uq_pos_t r = pos_first(uq), w = r, top;
+    int kept = 0;
+    bool dup = false; /* Whether the last kept string was seen again */
+    while (!pos_end(uq, r)) {
+        char *v = POS_VAL(r);
+        pos_next(uq, &r);
+        if (kept) {
+            top = w;
+            pos_prev(uq, &top);
+            if (!strcmp(POS_VAL(top), v)) {
+                free(v);
+                dup = true;
+                continue;
+            }
+            if (dup) {
+                free(POS_VAL(top));
+                w = top;
+                kept--;
+                dup = false;
+            }
+        }
+        POS_VAL(w) = v;
+        pos_next(uq, &w);
+        kept++;
+    }
+    if (dup) {
+        pos_prev(uq, &w);
+        free(POS_VAL(w));
+        kept--;
+    }
+
+    truncate_at(uq, w);
+    uq->size = kept;
+    return true;
+}
+
+/* Keep the strings s such that sign * strcmp(s, t) <= 0 for any t after s */
+static int keep_monotonic(uqueue_t *uq, int sign)
+{
+    if (!uq || !uq->size)
+        return 0;
+
+    uq_pos_t r = pos_first(uq), w = r;
+    int kept = 0;
+    while (!pos_end(uq, r)) {
+        char *v = POS_VAL(r);
+        pos_next(uq, &r);
+        /* Kept strings form a stack, which v pops until it is in order */
+        while (kept) {
+            uq_pos_t top = w;
+            pos_prev(uq, &top);
+            if (sign * strcmp(POS_VAL(top), v) <= 0)
+                break;
+            free(POS_VAL(top));
+            w = top;
+            kept--;
+        }
+        POS_VAL(w) = v;
+        pos_next(uq, &w);
+        kept++;
+    }
+
+    truncate_at(uq, w);
+    uq->size = kept;
+    return kept;
+}
+
+int uq_ascend(uqueue_t *uq)
+{
+    return keep_monotonic(uq, 1);
+}
+
+int uq_descend(uqueue_t *uq)
+{
+    return keep_monotonic(uq, -1);
+}
+
+/* Swap every two adjacent strings */
+void uq_swap(uqueue_t *uq)
+{
+    if (!uq)
+        return;
+    uq_pos_t a = pos_first(uq);
+    while (!pos_end(uq, a)) {
+        uq_pos_t b = a;
+        pos_next(uq, &b);
+        if (pos_end(uq, b))
+            break;
+        char *v = POS_VAL(a);
+        POS_VAL(a) = POS_VAL(b);
+        POS_VAL(b) = v;
+        a = b;
+        pos_next(uq, &a);
+    }
+}
+
+/* Reverse strings in queue */
+void uq_reverse(uqueue_t *uq)
+{
+    if (!uq)
+        return;
+
+    /* Mirror every chunk, free slots included, then reverse the chunks */
+    struct list_head *node, *safe;
+    list_for_each_safe(node, safe, &uq->chunks) {
+        uq_chunk_t *c = list_entry(node, uq_chunk_t, list);
+        for (int i = 0; i < UQ_CHUNK / 2; i++) {
+            char *v = c->values[i];
+            c->values[i] = c->values[UQ_CHUNK - 1 - i];
+            c->values[UQ_CHUNK - 1 - i] = v;
+        }
+        int begin = UQ_CHUNK - c->end;
+        c->end = UQ_CHUNK - c->begin;
+        c->begin = begin;
+        list_move(node, &uq->chunks);
+    }
+}
+
+/* Reverse the strings of the queue k at a time */
+void uq_reverseK(uqueue_t *uq, int k)
+{
+    if (!uq || k <= 1)
+        return;
+
+    uq_pos_t a = pos_first(uq);
+    for (int left = uq->size; left >= k; left -= k) {
+        uq_pos_t b = a, next;
+        pos_advance(&b, k - 1);
+        next = b;
+        pos_next(uq, &next);
+        for (int i = 0; i < k / 2; i++) {
+            char *v = POS_VAL(a);
+            POS_VAL(a) = POS_VAL(b);
+            POS_VAL(b) = v;
+            pos_next(uq, &a);
+            pos_prev(uq, &b);
+        }
+        a = next;
+    }
+}
+
+/* Copy the string pointers into arr, in queue order */
+static void gather(uqueue_t *uq, char **arr)
+{
+    uq_chunk_t *c;
+    list_for_each_entry(c, &uq->chunks, list) {
+        memcpy(arr, &c->values[c->begin], sizeof(char *) * (c->end - c->begin));
+        arr += c->end - c->begin;
+    }
+}
+
+/* Put the string pointers of arr back, in queue order */
+static void scatter(uqueue_t *uq, char **arr)
+{
+    uq_chunk_t *c;
+    list_for_each_entry(c, &uq->chunks, list) {
+        memcpy(&c->values[c->begin], arr, sizeof(char *) * (c->end - c->begin));
+        arr += c->end - c->begin;
+    }
+}
+
+/* Sort strings of queue in ascending/descending order */
+bool uq_sort(uqueue_t *uq, bool descend)
+{
+    if (!uq || uq->size < 2)
+        return true;
+
+    int n = uq->size;
+    char **src = malloc(sizeof(char *) * n * 2);
+    if (!src)
+        return false;
+    char **dst = src + n;
+    gather(uq, src);
+
+    /* Bottom-up merge sort, taking from the left run on ties */
+    for (int width = 1; width < n; width *= 2) {
+        for (int lo = 0; lo < n; lo += 2 * width) {
+            int mid = lo + width < n ? lo + width : n;
+            int hi = mid + width < n ? mid + width : n;
+            int i = lo, j = mid, o = lo;
+            while (i < mid && j < hi) {
+                int cmp = strcmp(src[i], src[j]);
+                dst[o++] = (descend ? cmp >= 0 : cmp <= 0) ? src[i++] : src[j++];
+            }
+            while (i < mid)
+                dst[o++] = src[i++];
+            while (j < hi)
+                dst[o++] = src[j++];
+        }
+        char **tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    scatter(uq, src);
+    free(src < dst ? src : dst);
+    return true;
+}
+
+/* Merge two sorted queues into the first one */
+bool uq_merge(uqueue_t *uq, uqueue_t *other, bool descend)
+{
+    if (!uq || !other || uq == other)
+        return false;
+    if (!other->size)
+        return true;
+    if (!uq->size) {
+        list_splice_init(&other->chunks, &uq->chunks);
+        uq->size = other->size;
+        other->size = 0;
+        return true;
+    }
+
+    /* After taking a string, the inputs have emptied all but at most two of
+     * the chunks the output has needed so far, which they hand over for
+     * reuse.
+     */
+    LIST_HEAD(spare);
+    for (int i = 0; i < 2; i++) {
+        uq_chunk_t *c = chunk_new(0);
+        if (!c) {
+            uq_chunk_t *safe;
+            list_for_each_entry_safe(c, safe, &spare, list)
+                chunk_drop(c);
+            return false;
+        }
+        list_add(&c->list, &spare);
+    }
+
+    LIST_HEAD(a);
+    LIST_HEAD(b);
+    LIST_HEAD(out);
+    list_splice_init(&uq->chunks, &a);
+    list_splice_init(&other->chunks, &b);
+    uq_chunk_t *oc = NULL;
+    while (!list_empty(&a) || !list_empty(&b)) {
+        uq_chunk_t *ca = list_empty(&a) ? NULL
+                                        : list_first_entry(&a, uq_chunk_t, list);
+        uq_chunk_t *cb = list_empty(&b) ? NULL
+                                        : list_first_entry(&b, uq_chunk_t, list);
+        uq_chunk_t *src = cb;
+        if (!cb) {
+            src = ca;
+        } else if (ca) {
+            int cmp = strcmp(ca->values[ca->begin], cb->values[cb->begin]);
+            if (descend ? cmp >= 0 : cmp <= 0)
+                src = ca;
+        }
+
+        char *v = src->values[src->begin++];
+        if (src->begin == src->end)
+            list_move(&src->list, &spare);
+        if (!oc || oc->end == UQ_CHUNK) {
+            oc = list_first_entry(&spare, uq_chunk_t, list);
+            list_move_tail(&oc->list, &out);
+            oc->begin = oc->end = 0;
+        }
+        oc->values[oc->end++] = v;
+    }
+
+    list_splice(&out, &uq->chunks);
+    uq->size += other->size;
+    other->size = 0;
+
+    uq_chunk_t *c, *safe;
+    list_for_each_entry_safe(c, safe, &spare, list)
+        chunk_drop(c);
+    return true;
+}
+
+/* Shuffle the queue with the Fisher-Yates algorithm */
+bool uq_shuffle(uqueue_t *uq)
+{
+    if (!uq || uq->size < 2)
+        return true;
+
+    int n = uq->size;
+    char **arr = malloc(sizeof(char *) * n);
+    if (!arr)
+        return false;
+    gather(uq, arr);
+
+    /* One seed from the selected generator, then a splitmix64 sequence */
+    uint64_t state;
+    rand_func[prng]((uint8_t *) &state, sizeof(state));
+    for (int i = n - 1; i > 0; i--) {
+        state += 0x9e3779b97f4a7c15ULL;
+        uint32_t x = (uint32_t) (random_shuffle(state) >> 32);
+        int j = (int) (((uint64_t) x * (uint64_t) (i + 1)) >> 32);
+        char *v = arr[i];
+        arr[i] = arr[j];
+        arr[j] = v;
+    }
+
+    scatter(uq, arr);
+    free(arr);
+    return true;
+}
@@ -0,0 +1,201 @@
+#ifndef LAB0_UQUEUE_H
+#define LAB0_UQUEUE_H
+
+/* This program implements the queue operations of queue.h on an unrolled
+ * list: a doubly-linked list of chunks, each holding up to UQ_CHUNK string
+ * pointers in an array.
+ *
+ * Walking the queue takes one pointer chase per chunk rather than one per
+ * element, at the cost of moving pointers around inside a chunk for the
+ * operations that delete in the middle.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "list.h"
+
+/* Number of strings per chunk */
+#define UQ_CHUNK 32
+
+/**
+ * uq_chunk_t - Chunk of an unrolled queue
+ * @list: node of the doubly-linked list of chunks
+ * @begin: index of the first string held in @values
+ * @end: index past the last string held in @values
+ * @values: strings of the chunk, in queue order
+ *
+ * A chunk in a queue is never empty. Free slots at the front of @values make
+ * room for insertions at the head, and free slots at the back for
+ * insertions at the tail.
+ */
+typedef struct {
+    struct list_head list;
+    int begin, end;
+    char *values[UQ_CHUNK];
+} uq_chunk_t;
+
+/**
+ * uqueue_t - Unrolled queue
+ * @chunks: head of the list of chunks
+ * @size: number of strings in the queue
+ */
+typedef struct {
+    struct list_head chunks;
+    int size;
+} uqueue_t;
+
+/**
+ * uq_new() - Create an empty queue
+ *
+ * Return: NULL for allocation failed
+ */
+uqueue_t *uq_new(void);
+
+/**
+ * uq_free() - Free all storage used by queue, no effect if @uq is NULL
+ * @uq: unrolled queue
+ */
+void uq_free(uqueue_t *uq);
+
+/**
+ * uq_insert_head() - Insert a copy of a string at the head
+ * @uq: unrolled queue
+ * @s: string would be inserted
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool uq_insert_head(uqueue_t *uq, const char *s);
+
+/**
+ * uq_insert_tail() - Insert a copy of a string at the tail
+ * @uq: unrolled queue
+ * @s: string would be inserted
+ *
+ * Return: true for success, false for allocation failed or queue is NULL
+ */
+bool uq_insert_tail(uqueue_t *uq, const char *s);
+
+/**
+ * uq_remove_head() - Remove the string at the head of queue
+ * @uq: unrolled queue
+ * @sp: output buffer where the removed string is copied, or NULL
+ * @bufsize: size of the string
+ *
+ * Like q_remove_head(), but the string is released as well, since there is no
+ * element to hand back.
+ *
+ * Return: true for success, false if queue is NULL or empty
+ */
+bool uq_remove_head(uqueue_t *uq, char *sp, size_t bufsize);
+
+/**
+ * uq_remove_tail() - Remove the string at the tail of queue
+ * @uq: unrolled queue
+ * @sp: output buffer where the removed string is copied, or NULL
+ * @bufsize: size of the string
+ *
+ * Return: true for success, false if queue is NULL or empty
+ */
+bool uq_remove_tail(uqueue_t *uq, char *sp, size_t bufsize);
+
+/**
+ * uq_size() - Get the size of the queue
+ * @uq: unrolled queue
+ *
+ * Return: the number of strings in queue, zero if queue is NULL or empty
+ */
+int uq_size(uqueue_t *uq);
+
+/**
+ * uq_delete_mid() - Delete the middle string in queue, as q_delete_mid()
+ * @uq: unrolled queue
+ *
+ * Return: true for success, false if queue is NULL or empty
+ */
+bool uq_delete_mid(uqueue_t *uq);
+
+/**
+ * uq_delete_dup() - Delete all strings that are duplicated in a sorted
+ * queue, as q_delete_dup()
+ * @uq: unrolled queue
+ *
+ * Return: true for success, false if queue is NULL or empty
+ */
+bool uq_delete_dup(uqueue_t *uq);
+
+/**
+ * uq_swap() - Swap every two adjacent strings, as q_swap()
+ * @uq: unrolled queue
+ */
+void uq_swap(uqueue_t *uq);
+
+/**
+ * uq_reverse() - Reverse strings in queue, as q_reverse()
+ * @uq: unrolled queue
+ */
+void uq_reverse(uqueue_t *uq);
+
+/**
+ * uq_reverseK() - Reverse the strings of the queue k at a time, as
+ * q_reverseK()
+ * @uq: unrolled queue
+ * @k: size of the groups
+ */
+void uq_reverseK(uqueue_t *uq, int k);
+
+/**
+ * uq_sort() - Sort strings of queue in ascending/descending order
+ * @uq: unrolled queue
+ * @descend: whether or not to sort in descending order
+ *
+ * The string pointers are merge sorted in a temporary array, so the sort is
+ * stable.
+ *
+ * Return: false if the temporary array could not be allocated, in which case
+ * the queue is left as it was
+ */
+bool uq_sort(uqueue_t *uq, bool descend);
+
+/**
+ * uq_ascend() - Delete every string which has a strictly less string
+ * anywhere to the right side of it, as q_ascend()
+ * @uq: unrolled queue
+ *
+ * Return: the number of strings in queue after performing operation
+ */
+int uq_ascend(uqueue_t *uq);
+
+/**
+ * uq_descend() - Delete every string which has a strictly greater string
+ * anywhere to the right side of it, as q_descend()
+ * @uq: unrolled queue
+ *
+ * Return: the number of strings in queue after performing operation
+ */
+int uq_descend(uqueue_t *uq);
+
+/**
+ * uq_merge() - Merge two sorted queues into the first one
+ * @uq: unrolled queue, holds the result
+ * @other: unrolled queue, left empty
+ * @descend: whether both queues are sorted in descending order
+ *
+ * Equal strings are taken from @uq first. Chunks emptied by the merge are
+ * reused for its output, so only two chunks are allocated up front.
+ *
+ * Return: false if those chunks could not be allocated, in which case both
+ * queues are left as they were
+ */
+bool uq_merge(uqueue_t *uq, uqueue_t *other, bool descend);
+
+/**
+ * uq_shuffle() - Shuffle the queue with the Fisher-Yates algorithm
+ * @uq: unrolled queue
+ *
+ * Return: false if the temporary array could not be allocated, in which case
+ * the queue is left as it was
+ */
+bool uq_shuffle(uqueue_t *uq);
+
+#endif /* LAB0_UQUEUE_H */